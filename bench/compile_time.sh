@@ -0,0 +1,116 @@
+#!/bin/sh
+# Compares how long the generated code takes to compile in the header-only mode and in the split mode
+# (`implementation` in the manifest). A synthetic corpus of programs is generated, and every translation
+# unit includes all of the program headers, like a renderer which draws with all of them would.
+#
+# Usage: bench/compile_time.sh [PROGRAMS] [TRANSLATION_UNITS]
+#   SHD      the generator, bin/Release/shader_descriptor by default
+#   CXX      the compiler, c++ by default
+#   INCLUDE  where glm/ and glad/ are found, tests/stub by default. Point it at the real headers
+#            to include their cost too.
+set -e
+
+programs=${1:-1000}
+units=${2:-8}
+root=$(cd "$(dirname "$0")/.." && pwd)
+shd=${SHD:-$root/bin/Release/shader_descriptor}
+cxx=${CXX:-c++}
+include=${INCLUDE:-$root/tests/stub}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+now()
+{
+    date +%s.%N
+}
+
+elapsed()
+{
+    awk "BEGIN { printf \"%.2f\", $2 - $1 }"
+}
+
+# Every program has a custom type, a uniform block and a few plain uniforms
+mkdir -p "$work/shaders"
+i=0
+while [ $i -lt $programs ]; do
+    cat > "$work/shaders/p$i.vs" <<EOF
+#version 330 core
+struct Light
+{
+    vec3 position;
+    vec3 color;
+    float radius;
+};
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec4 time;
+};
+uniform mat4 model_$i;
+uniform vec3 tint_$i;
+uniform vec2 offset_$i;
+uniform float scale_$i;
+uniform Light light;
+void main() {}
+EOF
+    cat > "$work/shaders/p$i.fs" <<EOF
+#version 330 core
+uniform vec4 color_$i;
+uniform float alpha;
+void main() {}
+EOF
+    i=$((i + 1))
+done
+
+for mode in inline split; do
+    mkdir -p "$work/$mode"
+    manifest="$work/$mode/manifest.txt"
+    echo "types $work/$mode/types.h" > "$manifest"
+    echo "buffers $work/$mode/buffers.h" >> "$manifest"
+    if [ $mode = split ]; then
+        echo "implementation $work/$mode/shd.cpp" >> "$manifest"
+    fi
+    i=0
+    while [ $i -lt $programs ]; do
+        echo "output $work/$mode/p$i.h" >> "$manifest"
+        echo "input $work/shaders/p$i.vs" >> "$manifest"
+        echo "input $work/shaders/p$i.fs" >> "$manifest"
+        i=$((i + 1))
+    done
+    "$shd" --manifest "$manifest"
+
+    all="$work/$mode/all.h"
+    : > "$all"
+    i=0
+    while [ $i -lt $programs ]; do
+        echo "#include \"p$i.h\"" >> "$all"
+        i=$((i + 1))
+    done
+    u=0
+    while [ $u -lt $units ]; do
+        printf '#include "all.h"\nint unit_%d() { return %d; }\n' $u $u > "$work/$mode/unit$u.cpp"
+        u=$((u + 1))
+    done
+done
+
+time_units()
+{
+    start=$(now)
+    u=0
+    while [ $u -lt $units ]; do
+        "$cxx" -std=c++17 -O2 -I "$include" -c "$work/$1/unit$u.cpp" -o "$work/$1/unit$u.o"
+        u=$((u + 1))
+    done
+    elapsed "$start" "$(now)"
+}
+
+inline_time=$(time_units inline)
+split_time=$(time_units split)
+start=$(now)
+"$cxx" -std=c++17 -O2 -I "$include" -c "$work/split/shd.cpp" -o "$work/split/shd.o"
+implementation_time=$(elapsed "$start" "$(now)")
+
+echo "$programs programs, $units translation units including all of them"
+echo "header-only: $inline_time s"
+echo "split:       $split_time s, plus $implementation_time s for the implementation file"
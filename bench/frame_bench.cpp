@@ -0,0 +1,97 @@
+// Times typical frame patterns of the code generated for bench/shaders against the stand-in GL of tests/stub,
+// whose functions only count the calls. This measures the cost of the generated code and of the number of
+// GL calls it makes, not of a driver. Build it once per backend to compare the emission strategies.
+//
+// Usage: frame_bench [DRAWS]
+#include "gl_stub.h"
+#include "bench.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Keeps the compiler from hoisting the values out of the loop
+static volatile float frame_time = 0.0f;
+
+struct Pattern
+{
+    const char* name;
+    void (*draw)(Bench_Program& program, Frame_Block& frame, int i);
+};
+
+static glm::mat4 matrix(float value)
+{
+    return { { { value, 0, 0, 0 }, { 0, value, 0, 0 }, { 0, 0, value, 0 }, { 0, 0, 0, 1 } } };
+}
+
+// Every uniform of the program changes for every draw
+static void draw_all(Bench_Program& program, Frame_Block&, int i)
+{
+    float t = frame_time + i;
+    program.use();
+    program.uniforms({ t, t, t, 1 }, { t, 0, 0 }, { { t, 1, 2 }, { 1, 1, 1 }, 10 }, 0.5f,
+        matrix(t), matrix(t), 0.25f, 1.0f, { t, t });
+}
+
+// Only the per-object uniforms change, the material is shared
+static void draw_partial(Bench_Program& program, Frame_Block&, int i)
+{
+    float t = frame_time + i;
+    program.use();
+    program.model(matrix(t));
+    program.normal_matrix(matrix(t));
+}
+
+// The per-frame block is updated member by member, and then as a whole
+static void draw_block(Bench_Program& program, Frame_Block& frame, int i)
+{
+    float t = frame_time + i;
+    program.use();
+#ifdef FRAME_BENCH_GL
+    // Without DSA, the setters upload to the buffer bound to GL_UNIFORM_BUFFER
+    frame.bind();
+#endif
+    frame.view(matrix(t));
+    frame.camera_position({ t, t, t, 1 });
+    frame.time(t);
+    Frame data = {};
+    data.time = t;
+    frame.data(&data);
+}
+
+int main(int argc, char** argv)
+{
+    int draws = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (draws <= 0)
+    {
+        fputs("Usage: frame_bench [DRAWS]\n", stderr);
+        return 1;
+    }
+
+    stub_gl_reset();
+    Bench_Program program;
+    program.id = glCreateProgram();
+    program.query_locations();
+    Frame_Block frame;
+    frame.create(0);
+    program.Frame_block(frame);
+
+    Pattern patterns[] = {
+        { "all uniforms", draw_all },
+        { "partial update", draw_partial },
+        { "block update", draw_block },
+    };
+    printf("%d draws per pattern\n", draws);
+    for (const Pattern& pattern : patterns)
+    {
+        stub_gl_calls = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < draws; i++)
+        {
+            pattern.draw(program, frame, i);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        printf("%-16s %8.1f ns/draw %6.1f GL calls/draw\n", pattern.name, ns / draws, (double)stub_gl_calls / draws);
+    }
+    return 0;
+}
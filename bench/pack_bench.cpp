@@ -0,0 +1,118 @@
+// Measures the pack() kernel generated for bench/shaders/pack.vs against a loop that copies each member 
+// (and each column of the mat3) with its own memcpy, which is what hand-written conversion code does.
+// Both fill an array of std140 records from tightly packed ones. The throughput is counted in bytes written,
+// for a cache-resident array and for one that is not. Build it with and without AVX, or with SHD_PACK_SCALAR.
+//
+// Usage: pack_bench [MEGABYTES]
+#include "buffers.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Keeps the compiler from dropping the copies
+static volatile char sink;
+
+static void pack_per_field(const Instance_Source* src, size_t n, void* dst)
+{
+    char* out = (char*)dst;
+    for (size_t i = 0; i < n; i++, out += Instance_Source::block_stride)
+    {
+        memcpy(out + offsetof(Instance, model), &src[i].model, sizeof(src[i].model));
+        for (size_t column = 0; column < 3; column++)
+        {
+            memcpy(out + offsetof(Instance, normal_matrix) + column * 16, (const char*)&src[i].normal_matrix + column * 12, 12);
+        }
+        memcpy(out + offsetof(Instance, color), &src[i].color, sizeof(src[i].color));
+        memcpy(out + offsetof(Instance, roughness), &src[i].roughness, sizeof(src[i].roughness));
+        memcpy(out + offsetof(Instance, emissive), &src[i].emissive, sizeof(src[i].emissive));
+    }
+}
+
+// Whether the members of all the records are the same. The padding is not compared, since it differs.
+static bool same_members(const std::vector<char>& a, const std::vector<char>& b)
+{
+    struct { size_t offset; size_t size; } members[] = {
+        { offsetof(Instance, model), 64 },
+        { offsetof(Instance, normal_matrix), 12 }, { offsetof(Instance, normal_matrix) + 16, 12 }, 
+        { offsetof(Instance, normal_matrix) + 32, 12 },
+        { offsetof(Instance, color), 16 }, // with the roughness
+        { offsetof(Instance, emissive), 12 },
+    };
+    for (size_t record = 0; record < a.size(); record += Instance_Source::block_stride)
+    {
+        for (const auto& member : members)
+        {
+            if (memcmp(&a[record + member.offset], &b[record + member.offset], member.size) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Returns the GB/s of the best of a few runs
+template <class Pack>
+static double measure(Pack pack, const std::vector<Instance_Source>& source, std::vector<char>& packed, size_t repeats)
+{
+    double best = 0;
+    for (int run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < repeats; r++)
+        {
+            pack(source.data(), source.size(), packed.data());
+            sink = packed[r % packed.size()];
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        best = std::max(best, (double)packed.size() * repeats / seconds / 1e9);
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    double megabytes = argc > 1 ? atof(argv[1]) : 64;
+    if (megabytes <= 0)
+    {
+        fputs("Usage: pack_bench [MEGABYTES]\n", stderr);
+        return 1;
+    }
+    const size_t stride = Instance_Source::block_stride;
+#if defined(SHD_PACK_AVX)
+    puts("pack() with AVX");
+#elif defined(SHD_PACK_SSE2)
+    puts("pack() with SSE2");
+#else
+    puts("pack() scalar");
+#endif
+    size_t sizes[] = { 16 * 1024, (size_t)(megabytes * 1024 * 1024) };
+    for (size_t bytes : sizes)
+    {
+        size_t n = bytes / stride;
+        std::vector<Instance_Source> source(n);
+        for (size_t i = 0; i < n * sizeof(Instance_Source) / sizeof(float); i++)
+        {
+            ((float*)source.data())[i] = (float)i;
+        }
+        std::vector<char> expected(n * stride), packed(n * stride);
+        pack_per_field(source.data(), n, expected.data());
+        pack(source.data(), n, packed.data());
+
+        if (!same_members(expected, packed))
+        {
+            fputs("pack_bench: pack() and the per-field copy differ\n", stderr);
+            return 1;
+        }
+
+        size_t repeats = std::max<size_t>(1, (256u << 20) / (n * stride));
+        double per_field = measure(pack_per_field, source, expected, repeats);
+        double kernel = measure([](const Instance_Source* src, size_t n, void* dst) { pack(src, n, dst); }, source, packed, repeats);
+        printf("%8zu records (%8.0f KB): per-field memcpy %6.2f GB/s, pack() %6.2f GB/s\n",
+            n, n * stride / 1024.0, per_field, kernel);
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+struct Light
+{
+    vec3 position;
+    vec3 color;
+    float radius;
+};
+
+uniform Light light;
+uniform vec4 base_color;
+uniform vec3 emissive;
+uniform float roughness;
+uniform float metallic;
+
+void main()
+{
+}
@@ -0,0 +1,25 @@
+#version 330 core
+
+struct Light
+{
+    vec3 position;
+    vec3 color;
+    float radius;
+};
+
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position;
+    float time;
+};
+
+uniform mat4 model;
+uniform mat4 normal_matrix;
+uniform vec2 uv_offset;
+uniform float scale;
+
+void main()
+{
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+// Per-instance data of a typical mesh, whose mat3 and vec3 members are padded in std140
+layout (std140) uniform Instance
+{
+    mat4 model;
+    mat3 normal_matrix;
+    vec3 color;
+    float roughness;
+    vec3 emissive;
+};
+
+void main()
+{
+}
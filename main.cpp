@@ -3,25 +3,98 @@
 #include <string.h>
 #include <vector>
 #include <map>
+#include <set>
 #include <cstdint>
+#include <stdarg.h>
+#include <ctype.h>
+#include <algorithm>
 #include "src/string_builder.h"
 #include "src/string_util.h"
 #include "src/writer.h"
+#include "src/preprocessor.h"
+#include "src/scan.h"
+
+// Part of the key of the program binary cache, so that binaries cached by code generated 
+// by an older version are not loaded. See `write_load_or_link`.
+#define SHD_GENERATOR_VERSION "shd 1.1"
 
 struct Uniform
 {
     const char* type; // not necessarity owned
     const char* name; // always owned
     const char* location_name; // always owned
+    const char* unit_name; // always owned, only used by samplers and images
+    const char* format; // the GL image format, e.g. GL_RGBA8, only used by images
+    const char* frequency; // the `// @frequency(name)` annotation of a loose uniform, null when not annotated
+    uint32_t offset; // the `layout(offset = N)` of a block member, 0 when not specified
+    int set;         // the `layout(set = N)` of a loose uniform, -1 when not specified
+    int binding;     // the `layout(binding = N)` of a loose uniform, -1 when not specified
 };
 
 typedef void (*WriteUniformFunc)(Writer* writer, const Uniform& u);
 
+// Which GL entry points the generated setters use.
+enum Backend
+{
+    // glUniform*, the program has to be bound with use() before setting uniforms
+    BACKEND_GL,
+    // Direct State Access (GL 4.5 or ARB_direct_state_access): glProgramUniform* and glNamedBuffer*,
+    // which don't require binding anything
+    BACKEND_DSA,
+    // Vulkan has no loose uniforms, so this backend emits no setters. Instead, it describes the 
+    // push constant ranges and descriptor set layouts of each program.
+    BACKEND_VULKAN,
+    BACKEND_COUNT
+};
+
+const char* backend_names[BACKEND_COUNT] = { "gl", "dsa", "vulkan" };
+
+struct Iteration_Option
+{
+    std::vector<const char*> input_files;
+    const char* output_file;
+    const char* output_struct_name;
+    std::map<std::string, Pp_Macro> defines; // in addition to the global ones
+};
+
+struct Options
+{
+    int spaces_per_tab;
+    const char* uniform_buffer_file;
+    const char* custom_types_file;
+    std::vector<Iteration_Option> iteration_options;
+    std::vector<const char*> include_paths;
+    std::map<std::string, Pp_Macro> defines;
+    // When set, method definitions are emitted into this file instead of inline in the headers
+    const char* implementation_file;
+    Backend backend;
+    // Whether to generate repack kernels for the uniform blocks, see `write_pack_kernel`
+    bool pack_kernels;
+    // Uniform blocks to generate a `<Block>_Batch` for, see `write_batch_declaration`
+    std::set<std::string> batched_blocks;
+    // Whether samplers and images are set as ARB_bindless_texture handles instead of being bound to units
+    bool bindless_textures;
+    // Whether the generated setters count their calls behind SHD_STATS, see `write_stats_preamble`
+    bool stats;
+    // The header declaring the GL entry points, included as <gl_header>
+    const char* gl_header;
+    // Whether to generate `<Name>_Recorder` and `replay()`, see `write_record_preamble`
+    bool record;
+    // Whether to generate `load_or_link()`, see `write_load_or_link`
+    bool binary_cache;
+};
+
 struct Uniform_Type_Info
 {
-    WriteUniformFunc write_func;
-    uint32_t size_in_bytes;
+    WriteUniformFunc write_funcs[BACKEND_COUNT];
+    uint32_t size_in_bytes; // in a std140 or std430 block
     uint32_t base_alignment;
+    // The columns of a matrix are 16 bytes apart in a block, while the CPU type is tightly packed.
+    // Vectors and scalars are a single column.
+    uint32_t column_count;
+    uint32_t column_size;
+    // The type of the member in the block mirror, when the CPU type has another layout. Null otherwise.
+    const char* block_type;
 };
 
 struct Struct
@@ -36,6 +109,9 @@ struct Uniform_Block
     std::vector<uint32_t> pad_bytes;
     uint32_t total_size;
     std::vector<Uniform> members;
+    // From the layout qualifiers. Only used by the vulkan backend, by the batches and by the repack kernels.
+    bool std430;
+    bool push_constant;
 };
 
 void write_float32(Writer* writer, const Uniform& u)
@@ -58,6 +134,35 @@ void write_mat4(Writer* writer, const Uniform& u)
 {
     wr_format_line(writer, "glUniformMatrix4fv(%s, 1, GL_FALSE, (float*)&%s);", u.location_name, u.name);
 }
+void write_mat3(Writer* writer, const Uniform& u)
+{
+    wr_format_line(writer, "glUniformMatrix3fv(%s, 1, GL_FALSE, (float*)&%s);", u.location_name, u.name);
+}
+
+void write_program_float32(Writer* writer, const Uniform& u)
+{
+    wr_format_line(writer, "glProgramUniform1f(id, %s, %s);", u.location_name, u.name);
+}
+void write_program_vec4(Writer* writer, const Uniform& u)
+{
+    wr_format_line(writer, "glProgramUniform4fv(id, %s, 1, (float*)&%s);", u.location_name, u.name);
+}
+void write_program_vec3(Writer* writer, const Uniform& u)
+{
+    wr_format_line(writer, "glProgramUniform3fv(id, %s, 1, (float*)&%s);", u.location_name, u.name);
+}
+void write_program_vec2(Writer* writer, const Uniform& u)
+{
+    wr_format_line(writer, "glProgramUniform2fv(id, %s, 1, (float*)&%s);", u.location_name, u.name);
+}
+void write_program_mat4(Writer* writer, const Uniform& u)
+{
+    wr_format_line(writer, "glProgramUniformMatrix4fv(id, %s, 1, GL_FALSE, (float*)&%s);", u.location_name, u.name);
+}
+void write_program_mat3(Writer* writer, const Uniform& u)
+{
+    wr_format_line(writer, "glProgramUniformMatrix3fv(id, %s, 1, GL_FALSE, (float*)&%s);", u.location_name, u.name);
+}
 
 
 std::map<std::string, const char*> glsl_to_uniform_type_map
@@ -66,6 +171,7 @@ std::map<std::string, const char*> glsl_to_uniform_type_map
     { "vec2", "glm::vec2" },
     { "vec3", "glm::vec3" },
     { "vec4", "glm::vec4" },
+    { "mat3", "glm::mat3" },
     { "mat4", "glm::mat4" }
 };
 
@@ -73,15 +179,71 @@ std::map<std::string, std::vector<Uniform>> custom_types;
 
 std::map<std::string, Uniform_Type_Info> uniform_type_map
 {
-    { "glm::float32", { write_float32, 4,         4 } },
-    { "glm::vec4",    { write_vec4,    4 * 4,     16 } },
-    { "glm::vec3",    { write_vec3,    3 * 4,     16 } },
-    { "glm::vec2",    { write_vec2,    2 * 4,     8 } },
-    { "glm::mat4",    { write_mat4,    4 * 4 * 4, 16 } }  
+    { "glm::float32", { { write_float32, write_program_float32 }, 4,         4,  1, 4,     0 } },
+    { "glm::vec4",    { { write_vec4,    write_program_vec4 },    4 * 4,     16, 1, 4 * 4, 0 } },
+    { "glm::vec3",    { { write_vec3,    write_program_vec3 },    3 * 4,     16, 1, 3 * 4, 0 } },
+    { "glm::vec2",    { { write_vec2,    write_program_vec2 },    2 * 4,     8,  1, 2 * 4, 0 } },
+    { "glm::mat3",    { { write_mat3,    write_program_mat3 },    3 * 4 * 4, 16, 3, 3 * 4, "glm::mat3x4" } },
+    { "glm::mat4",    { { write_mat4,    write_program_mat4 },    4 * 4 * 4, 16, 4, 4 * 4, 0 } }  
 };
 
+// The type of a member in a block mirror
+inline const char* block_member_type(const Uniform& member)
+{
+    const char* block_type = uniform_type_map[member.type].block_type;
+    return block_type != 0 ? block_type : member.type;
+}
+
 std::map<std::string, Uniform_Block> uniform_blocks;
 
+// Samplers and images are opaque, the setters take a texture instead of a value. Each one is assigned 
+// a texture (or image) unit at generation time, which is set once in query_locations(), so that the 
+// setters only have to bind the texture. In the bindless mode, the setters take a texture handle instead.
+struct Opaque_Type_Info
+{
+    const char* target;
+    bool image;
+    bool layered; // whether images bind all the layers of the texture
+};
+
+std::map<std::string, Opaque_Type_Info> opaque_types
+{
+    { "sampler1D",            { "GL_TEXTURE_1D",             false, false } },
+    { "sampler2D",            { "GL_TEXTURE_2D",             false, false } },
+    { "sampler3D",            { "GL_TEXTURE_3D",             false, false } },
+    { "samplerCube",          { "GL_TEXTURE_CUBE_MAP",       false, false } },
+    { "sampler2DArray",       { "GL_TEXTURE_2D_ARRAY",       false, false } },
+    { "sampler2DShadow",      { "GL_TEXTURE_2D",             false, false } },
+    { "samplerCubeShadow",    { "GL_TEXTURE_CUBE_MAP",       false, false } },
+    { "sampler2DArrayShadow", { "GL_TEXTURE_2D_ARRAY",       false, false } },
+    { "sampler2DMS",          { "GL_TEXTURE_2D_MULTISAMPLE", false, false } },
+    { "samplerBuffer",        { "GL_TEXTURE_BUFFER",         false, false } },
+    { "isampler2D",           { "GL_TEXTURE_2D",             false, false } },
+    { "usampler2D",           { "GL_TEXTURE_2D",             false, false } },
+    { "image1D",              { "GL_TEXTURE_1D",             true,  false } },
+    { "image2D",              { "GL_TEXTURE_2D",             true,  false } },
+    { "image3D",              { "GL_TEXTURE_3D",             true,  true } },
+    { "imageCube",            { "GL_TEXTURE_CUBE_MAP",       true,  true } },
+    { "image2DArray",         { "GL_TEXTURE_2D_ARRAY",       true,  true } },
+    { "iimage2D",             { "GL_TEXTURE_2D",             true,  false } },
+    { "uimage2D",             { "GL_TEXTURE_2D",             true,  false } }
+};
+
+inline bool is_opaque_type(const char* type)
+{
+    return opaque_types.find(type) != opaque_types.end();
+}
+
+// The C++ type of a uniform in the generated setters and structs.
+inline const char* parameter_type(Options* options, const Uniform& u)
+{
+    if (is_opaque_type(u.type))
+    {
+        return options->bindless_textures ? "GLuint64" : "GLuint";
+    }
+    return u.type;
+}
+
 // Stores the file currently being processed and the line number
 struct Parse_Info
 {
@@ -103,7 +265,8 @@ inline const char* try_map_type(const char* unmapped_type, Parse_Info parse_info
         type = string_copy_with_malloc(unmapped_type);        
     }
 
-    if (uniform_type_map.find(type) == uniform_type_map.end() && custom_types.find(type) == custom_types.end())
+    if (uniform_type_map.find(type) == uniform_type_map.end() && custom_types.find(type) == custom_types.end()
+        && !is_opaque_type(type))
     {
         fprintf(stderr, "shd Error: Unrecognized type: \"%s\" in file %s, line %d.\n", 
             type, parse_info.file, parse_info.line);
@@ -136,38 +299,235 @@ inline Uniform wrap_struct_member(const Uniform uniform, const Uniform member_in
     sb_chr(location, '_');
     sb_cat(location, member_info.location_name);
 
+    auto unit = sb_create(64);
+    sb_cat(unit, uniform.name);
+    sb_chr(unit, '_');
+    sb_cat(unit, member_info.unit_name);
+
     Uniform result;
     result.type = member_info.type;
     result.name = sb_build(name); 
     result.location_name = sb_build(location);
+    result.unit_name = sb_build(unit);
+    result.format = member_info.format;
+    result.frequency = 0;
+    result.offset = 0;
+    result.set = -1;
+    result.binding = -1;
 
     return result;
 }
 
-inline void write_header(Writer* writer)
+inline void write_header(Writer* writer, Options* options)
 {
     wr_puts(writer,
         "#pragma once\n" \
         "// Warning: This file has been autogenerated by the tool!\n"\
-        "#include <glm/glm.hpp>\n" \
-        "#include <glad/gl.h>\n"
+        "#include <glm/glm.hpp>\n"
+    );
+    wr_format_line(writer, "#include <%s>", options->gl_header);
+}
+
+// Used instead of `write_header` when the implementation is emitted separately.
+// Only forward declarations are needed to declare the methods, which keeps the generated headers cheap to include.
+inline void write_lean_header(Writer* writer, Options* options)
+{
+    wr_puts(writer,
+        "#pragma once\n" \
+        "// Warning: This file has been autogenerated by the tool!\n"\
+        "#include <glm/fwd.hpp>\n" \
+        "typedef unsigned int GLuint;\n" \
+        "typedef int GLint;\n"
     );
+    if (options->bindless_textures)
+    {
+        wr_line(writer, "#include <stdint.h>");
+        wr_line(writer, "typedef uint64_t GLuint64;");
+    }
+}
+
+// Where the methods of a generated struct go. In the default header-only mode they are defined inline
+// in the struct. In the split mode only the declarations go into the header, while the definitions
+// go into the implementation file shared by all programs.
+struct Method_Target
+{
+    Writer* header;
+    Writer* implementation; // null in the header-only mode
+    const char* struct_name; // null for free functions
+};
+
+Writer* begin_method_v(Method_Target* target, const char* return_type, const char* format, va_list args)
+{
+    // Signatures with many parameters (like `uniforms(...)`) can get arbitrarily long
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(0, 0, format, copy);
+    va_end(copy);
+    std::string buffer(length + 1, '\0');
+    vsnprintf(&buffer[0], buffer.size(), format, args);
+    const char* signature = buffer.c_str();
+
+    if (target->implementation == 0)
+    {
+        wr_format_line(target->header, "inline %s %s", return_type, signature);
+        wr_start_block(target->header);
+        return target->header;
+    }
+
+    wr_format_line(target->header, "%s %s;", return_type, signature);
+    if (target->struct_name == 0)
+    {
+        wr_format_line(target->implementation, "%s %s", return_type, signature);
+    }
+    else
+    {
+        wr_format_line(target->implementation, "%s %s::%s", return_type, target->struct_name, signature);
+    }
+    wr_start_block(target->implementation);
+    return target->implementation;
+}
+
+// Writes the signature of a method, given as a format string like "%s(glm::vec3 value)" without
+// the return type, and opens its body. Returns the writer the body should be written to.
+Writer* begin_method(Method_Target* target, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    Writer* body = begin_method_v(target, "void", format, args);
+    va_end(args);
+    return body;
+}
+
+// Same as `begin_method`, for methods that return something other than void.
+Writer* begin_typed_method(Method_Target* target, const char* return_type, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    Writer* body = begin_method_v(target, return_type, format, args);
+    va_end(args);
+    return body;
+}
+
+inline void end_method(Writer* writer)
+{
+    wr_end_block(writer);
+}
+
+// Binds the texture to the unit of the sampler or image, or sets the handle in the bindless mode.
+inline void write_opaque(Writer* writer, Options* options, const Uniform& u)
+{
+    const Opaque_Type_Info& info = opaque_types[u.type];
+    if (options->bindless_textures)
+    {
+        if (options->backend == BACKEND_DSA)
+        {
+            wr_format_line(writer, "glProgramUniformHandleui64ARB(id, %s, %s);", u.location_name, u.name);
+        }
+        else
+        {
+            wr_format_line(writer, "glUniformHandleui64ARB(%s, %s);", u.location_name, u.name);
+        }
+    }
+    else if (info.image && u.format == 0)
+    {
+        wr_line(writer, "GLint format;");
+        wr_format_line(writer, "glGetTextureLevelParameteriv(%s, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);", u.name);
+        wr_format_line(writer, "glBindImageTexture(%s, %s, 0, %s, 0, GL_READ_WRITE, (GLenum)format);", 
+            u.unit_name, u.name, info.layered ? "GL_TRUE" : "GL_FALSE");
+    }
+    else if (info.image)
+    {
+        wr_format_line(writer, "glBindImageTexture(%s, %s, 0, %s, 0, GL_READ_WRITE, %s);", 
+            u.unit_name, u.name, info.layered ? "GL_TRUE" : "GL_FALSE", u.format);
+    }
+    else if (options->backend == BACKEND_DSA)
+    {
+        wr_format_line(writer, "glBindTextureUnit(%s, %s);", u.unit_name, u.name);
+    }
+    else
+    {
+        wr_format_line(writer, "glActiveTexture(GL_TEXTURE0 + %s);", u.unit_name);
+        wr_format_line(writer, "glBindTexture(%s, %s);", info.target, u.name);
+    }
 }
 
 // Writes the code for setting the specified uniform to the specified stream.
 // TODO: wrap once and pass into this function a vector of already wrapped things
-inline void write_uniform(Writer* writer, const Uniform& u)
+inline void write_uniform(Writer* writer, Options* options, const Uniform& u)
 {
     if (custom_types.find(u.type) != custom_types.end())
     {
         for (auto member_info : custom_types[u.type])
         {
-            write_uniform(writer, wrap_struct_member(u, member_info));
+            write_uniform(writer, options, wrap_struct_member(u, member_info));
         }
     }
+    else if (is_opaque_type(u.type))
+    {
+        write_opaque(writer, options, u);
+    }
     else
     {
-        uniform_type_map[u.type].write_func(writer, u);
+        uniform_type_map[u.type].write_funcs[options->backend](writer, u);
+    }
+}
+
+// The texture and image units of a program, indexed by whether the type is an image
+struct Unit_Numbering
+{
+    std::set<int> explicit_units[2]; // given with layout(binding = N)
+    int next[2];
+    int count;
+};
+
+// Assigns its unit to each sampler and image: the one of layout(binding = N) if given, otherwise the next
+// unit no other sampler or image was given explicitly, in declaration order, so that the assignment is
+// the same on every run.
+inline void write_unit_declaration(Writer* writer, const Uniform& u, Unit_Numbering* units)
+{
+    if (custom_types.find(u.type) != custom_types.end())
+    {
+        for (auto member_info : custom_types[u.type])
+        {
+            write_unit_declaration(writer, wrap_struct_member(u, member_info), units);
+        }
+    }
+    else if (is_opaque_type(u.type))
+    {
+        int kind = opaque_types[u.type].image ? 1 : 0;
+        int unit = u.binding;
+        if (unit < 0)
+        {
+            while (units->explicit_units[kind].count(units->next[kind]) != 0)
+            {
+                units->next[kind]++;
+            }
+            unit = units->next[kind]++;
+        }
+        wr_format_line(writer, "static const GLint %s = %d;", u.unit_name, unit);
+        units->count++;
+    }
+}
+
+inline void write_unit_assignment(Writer* writer, Backend backend, const Uniform& u)
+{
+    if (custom_types.find(u.type) != custom_types.end())
+    {
+        for (auto member_info : custom_types[u.type])
+        {
+            write_unit_assignment(writer, backend, wrap_struct_member(u, member_info));
+        }
+    }
+    else if (is_opaque_type(u.type))
+    {
+        if (backend == BACKEND_DSA)
+        {
+            wr_format_line(writer, "glProgramUniform1i(id, %s, %s);", u.location_name, u.unit_name);
+        }
+        else
+        {
+            wr_format_line(writer, "glUniform1i(%s, %s);", u.location_name, u.unit_name);
+        }
     }
 }
 
@@ -201,395 +561,2652 @@ inline void write_location(Writer* writer, const Uniform& u)
     }
 }
 
-void write_struct_declaration(Writer* wr, const std::string& type, const std::vector<Uniform>& uniforms)
+// Collects the location variables of a uniform, which are many for a uniform of a custom type.
+inline void collect_locations(const Uniform& u, std::vector<std::string>& locations)
+{
+    if (custom_types.find(u.type) != custom_types.end())
+    {
+        for (auto member_info : custom_types[u.type])
+        {
+            collect_locations(wrap_struct_member(u, member_info), locations);
+        }
+    }
+    else
+    {
+        locations.push_back(u.location_name);
+    }
+}
+
+void write_struct_declaration(Writer* wr, Options* options, const std::string& type, const std::vector<Uniform>& uniforms)
 {
     wr_format_line(wr, "struct %s", type.c_str());
     wr_start_struct(wr);
     for (auto const& u : uniforms)
     {
-        wr_format_line(wr, "%s %s;", u.type, u.name);
+        wr_format_line(wr, "%s %s;", parameter_type(options, u), u.name);
     }
     wr_end_struct(wr);
 }
 
-void write_custom_type_declarations(Writer* wr)
+void write_custom_type_declarations(Writer* wr, Options* options)
 {
     // print custom types
     for (const auto& [type, uniforms] : custom_types)
     {
-        write_struct_declaration(wr, type, uniforms);
+        write_struct_declaration(wr, options, type, uniforms);
     }
 }
 
-void write_uniform_buffer_declaration(Writer* wr, const std::string& type, const Uniform_Block& block)
+// The distance between consecutive records when the block layout is used for an array element.
+// std140 rounds it up to a multiple of 16, std430 only to the largest member alignment.
+inline uint32_t block_array_stride(const Uniform_Block& block)
 {
-    // wr_line(wr, "#pragma push");
-    // wr_line(wr, "#pragma pack(1)");
-    wr_format_line(wr, "struct %s", type.c_str());
-    wr_start_struct(wr);
-    // Although the padding is inserted automatically, it is arch dependent
-    // Which is why we'd better add it manually.
-    // UPDATE: pack(16) is also an option, but I'm not sure how it plays out with the opengl format.
+    uint32_t alignment = 16;
+    if (block.std430)
     {
-        uint32_t pad_count = 0;
-        for (int i = 0; i < block.members.size(); i++)
+        alignment = 4;
+        for (const auto& member : block.members)
         {
-            if (block.pad_bytes[i] > 0)
-            {
-                wr_format_line(wr, "char _padding_%u[%u];", pad_count, block.pad_bytes[i]);
-                pad_count++;
-            }
-            const auto& member = block.members[i];
-            wr_format_line(wr, "%s %s;", member.type, member.name);
+            alignment = std::max(alignment, uniform_type_map[member.type].base_alignment);
         }
     }
-    wr_end_struct(wr);
-    // wr_line(wr, "#pragma pop");
-
-    wr_format_line(wr, "struct %s_Block", type.c_str());
-    wr_start_struct(wr);
-    
-    // Buffer id
-    wr_line(wr, "GLuint id;");
-    wr_line(wr, "GLuint binding_point;");
-    
-    // Create method
-    wr_line(wr, "inline void create(GLuint binding_point)");
-    wr_start_block(wr);
-    wr_line(wr, "glGenBuffers(1, &id);");
-    wr_line(wr, "glBindBuffer(GL_UNIFORM_BUFFER, id);");
-    wr_format_line(wr, "glBufferData(GL_UNIFORM_BUFFER, %u, NULL, GL_STATIC_DRAW);", block.total_size);
-    wr_line(wr, "glBindBuffer(GL_UNIFORM_BUFFER, 0);");
-    wr_line(wr, "this->binding_point = binding_point;");
-    wr_line(wr, "glBindBufferBase(GL_UNIFORM_BUFFER, binding_point, id);");
-    wr_end_block(wr);
-
-    // Bind method
-    wr_line(wr, "inline void bind()");
-    wr_start_block(wr);
-    wr_line(wr, "glBindBuffer(GL_UNIFORM_BUFFER, id);");
-    wr_end_block(wr);
+    return (block.total_size + alignment - 1) / alignment * alignment;
+}
 
-    // Set-all method
-    wr_format_line(wr, "inline void data(%s* data)", type.c_str()); 
-    wr_start_block(wr);
-    wr_format_line(wr, "glBufferData(GL_UNIFORM_BUFFER, %u, data, GL_STATIC_DRAW);", block.total_size);
-    wr_end_block(wr);
+// The generated kernels pick their instruction set at compile time. Define SHD_PACK_SCALAR to use the scalar 
+// version instead, e.g. to compare them.
+inline void write_pack_preamble(Writer* wr)
+{
+    wr_puts(wr,
+        "#include <stddef.h>\n" \
+        "#include <string.h>\n" \
+        "#if defined(__AVX__) && !defined(SHD_PACK_SCALAR) && !defined(SHD_PACK_AVX)\n" \
+        "#include <immintrin.h>\n" \
+        "#define SHD_PACK_AVX\n" \
+        "#endif\n" \
+        "#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(SHD_PACK_SCALAR) && !defined(SHD_PACK_SSE2)\n" \
+        "#include <emmintrin.h>\n" \
+        "#define SHD_PACK_SSE2\n" \
+        "// Moves the last 3 floats to the front, for a vec3 loaded together with the 4 bytes before it\n" \
+        "inline __m128 shd_pack_shift(__m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 2, 1)); }\n" \
+        "#endif\n"
+    );
+}
 
-    // Member offsets
-    for (int i = 0; i < block.offsets.size(); i++)
-    {
-        const auto& member = block.members[i];
-        uint32_t offset = block.offsets[i];
-        wr_format_line(wr, "const GLuint %s_offset = %u;", member.name, offset);
-    }
+// Instrumentation of the generated setters. Everything is wrapped in `#ifdef SHD_STATS`, so that
+// the generated code is exactly the same as without instrumentation unless the macro is defined.
+// Each program and block wrapper gets a `stats` array with one entry per setter, a copy of the last values
+// to detect redundant calls, and `dump_stats()` and `reset_stats()`. Resetting clears the counters but keeps
+// the last values, so that the first call after it can be redundant too. Binding a texture counts no bytes.
+inline void write_stats_preamble(Writer* wr)
+{
+    wr_puts(wr,
+        "#ifdef SHD_STATS\n" \
+        "#ifndef SHD_STATS_DEFINED\n" \
+        "#define SHD_STATS_DEFINED\n" \
+        "#include <stdio.h>\n" \
+        "#include <string.h>\n" \
+        "struct Shd_Uniform_Stats\n" \
+        "{\n" \
+        "    const char* name;\n" \
+        "    unsigned long long calls;\n" \
+        "    unsigned long long bytes;\n" \
+        "    unsigned long long redundant; // calls that set the value that was already set\n" \
+        "    bool set; // whether the last value is known, kept by shd_reset_stats\n" \
+        "};\n" \
+        "inline void shd_record(Shd_Uniform_Stats* stats, void* last, const void* value, size_t size, size_t bytes)\n" \
+        "{\n" \
+        "    if (stats->set && memcmp(last, value, size) == 0) stats->redundant++;\n" \
+        "    memcpy(last, value, size);\n" \
+        "    stats->set = true;\n" \
+        "    stats->calls++;\n" \
+        "    stats->bytes += bytes;\n" \
+        "}\n" \
+        "inline void shd_dump_stats(const char* owner, const Shd_Uniform_Stats* stats, int count)\n" \
+        "{\n" \
+        "    printf(\"%s\\n\", owner);\n" \
+        "    for (int i = 0; i < count; i++)\n" \
+        "        printf(\"    %-32s %10llu calls %12llu bytes %10llu redundant\\n\", stats[i].name, stats[i].calls, stats[i].bytes, stats[i].redundant);\n" \
+        "}\n" \
+        "inline void shd_reset_stats(Shd_Uniform_Stats* stats, int count)\n" \
+        "{\n" \
+        "    for (int i = 0; i < count; i++) stats[i].calls = stats[i].bytes = stats[i].redundant = 0;\n" \
+        "}\n" \
+        "#endif\n" \
+        "#endif\n"
+    );
+}
 
-    // Setting data
-    for (int i = 0; i < block.offsets.size(); i++)
+// Declares the `stats` array of a struct, given the names of its entries.
+inline void write_stats_declaration(Writer* wr, const std::vector<std::string>& names)
+{
+    std::string initializer;
+    for (const auto& name : names)
     {
-        const auto& member = block.members[i];
-        uint32_t offset = block.offsets[i];
-
-        wr_format_line(wr, "inline void %s(%s %s)", member.name, member.type, member.name);
-        wr_start_block(wr);
-        wr_format_line(wr, "glBufferSubData(GL_UNIFORM_BUFFER, %s_offset, %u, glm::value_ptr(%s));", 
-            member.name, uniform_type_map[{ member.type }].size_in_bytes, member.name);
-        wr_end_block(wr);
+        if (!initializer.empty())
+        {
+            initializer += ", ";
+        }
+        // Every field, so that the code is clean with -Wmissing-field-initializers
+        initializer += "{ \"" + name + "\", 0, 0, 0, false }";
     }
-
-    wr_end_struct(wr);
+    wr_format_line(wr, "Shd_Uniform_Stats stats[%d] = { %s };", (int)names.size(), initializer.c_str());
 }
 
+// Counts a call of a setter at the start of its body.
+inline void write_stats_record(Writer* body, int index, const char* last, const char* value, const char* size, const char* bytes)
+{
+    wr_line(body, "#ifdef SHD_STATS");
+    wr_format_line(body, "shd_record(&stats[%d], &%s, %s, %s, %s);", index, last, value, size, bytes);
+    wr_line(body, "#endif");
+}
 
-void write_uniform_buffer_declarations(Writer* wr)
+// The guard has to be repeated in the implementation file in the split mode.
+inline void write_stats_guard(Method_Target* target, const char* line)
 {
-    // Print uniform block layout types
-    for (auto const& [type, block] : uniform_blocks)
-    {   
-        write_uniform_buffer_declaration(wr, type, block);
+    wr_line(target->header, line);
+    if (target->implementation != 0)
+    {
+        wr_line(target->implementation, line);
     }
 }
 
-Uniform parse_as_declaration(char* buffer, Parse_Info parse_info)
+inline void write_stats_methods(Method_Target* target, int count)
 {
-    char *type_start = buffer;
-    char *type_end = strchr(type_start, ' ');
-    *type_end = '\0';
-
-    char *name_start = type_end + 1;
-    char *name_end = strchr(name_start, ';');
-    *name_end = '\0';
-
-    // TODO: add support for arrays
-    const char* type = try_map_type(type_start, parse_info);
-
-    auto location = sb_create(64);
-    sb_cat(location, name_start);
-    sb_cat(location, "_location");
-
-    const char* name = string_copy_with_malloc(name_start);
-
-    Uniform result = { type, name, sb_build(location) };
+    write_stats_guard(target, "#ifdef SHD_STATS");
+    Writer* body = begin_method(target, "dump_stats()");
+    wr_format_line(body, "shd_dump_stats(\"%s\", stats, %d);", target->struct_name, count);
+    end_method(body);
+    body = begin_method(target, "reset_stats()");
+    wr_format_line(body, "shd_reset_stats(stats, %d);", count);
+    end_method(body);
+    write_stats_guard(target, "#endif");
+}
 
-    return result;
+// Recording of setter calls on threads other than the GL thread. A `<Name>_Recorder` appends each call 
+// to a command stream, as a `Shd_Command` header (the index of the setter and the size of the value) followed 
+// by the value itself. `end_draw()` marks where a draw happens. The GL thread replays the streams with 
+// `<Name>_Program::replay()`, one draw at a time, which calls the same setters as a direct call would.
+// The streams are handed over through `Shd_Command_Queue`, a lock-free single-producer single-consumer ring,
+// one per worker thread.
+inline void write_record_preamble(Writer* wr)
+{
+    wr_puts(wr,
+        "#ifndef SHD_RECORD_DEFINED\n" \
+        "#define SHD_RECORD_DEFINED\n" \
+        "#include <stddef.h>\n" \
+        "#include <stdint.h>\n" \
+        "#include <stdlib.h>\n" \
+        "#include <string.h>\n" \
+        "#include <atomic>\n" \
+        "#define SHD_END_DRAW 0xFFFF\n" \
+        "#define SHD_COMMAND_QUEUE_SIZE 64\n" \
+        "struct Shd_Command\n" \
+        "{\n" \
+        "    uint16_t opcode;\n" \
+        "    uint16_t size;\n" \
+        "};\n" \
+        "struct Shd_Command_Stream\n" \
+        "{\n" \
+        "    char* data;\n" \
+        "    size_t size;\n" \
+        "    size_t capacity;\n" \
+        "};\n" \
+        "inline void shd_record_command(Shd_Command_Stream* stream, uint16_t opcode, const void* value, uint16_t size)\n" \
+        "{\n" \
+        "    size_t needed = stream->size + sizeof(Shd_Command) + size;\n" \
+        "    if (needed > stream->capacity)\n" \
+        "    {\n" \
+        "        stream->capacity = needed > stream->capacity * 2 ? needed : stream->capacity * 2;\n" \
+        "        stream->data = (char*)realloc(stream->data, stream->capacity);\n" \
+        "    }\n" \
+        "    Shd_Command command = { opcode, size };\n" \
+        "    memcpy(stream->data + stream->size, &command, sizeof(command));\n" \
+        "    if (size > 0) memcpy(stream->data + stream->size + sizeof(command), value, size);\n" \
+        "    stream->size = needed;\n" \
+        "}\n" \
+        "struct Shd_Command_Queue\n" \
+        "{\n" \
+        "    Shd_Command_Stream* slots[SHD_COMMAND_QUEUE_SIZE];\n" \
+        "    // On cache lines of their own, so that the threads don't invalidate each other's line at every push and pop\n" \
+        "    alignas(64) std::atomic<uint32_t> head{0}; // only written by the consumer\n" \
+        "    alignas(64) std::atomic<uint32_t> tail{0}; // only written by the producer\n" \
+        "};\n" \
+        "// Returns false if the queue is full.\n" \
+        "inline bool shd_queue_push(Shd_Command_Queue* queue, Shd_Command_Stream* stream)\n" \
+        "{\n" \
+        "    uint32_t tail = queue->tail.load(std::memory_order_relaxed);\n" \
+        "    if (tail - queue->head.load(std::memory_order_acquire) == SHD_COMMAND_QUEUE_SIZE) return false;\n" \
+        "    queue->slots[tail % SHD_COMMAND_QUEUE_SIZE] = stream;\n" \
+        "    queue->tail.store(tail + 1, std::memory_order_release);\n" \
+        "    return true;\n" \
+        "}\n" \
+        "// Returns null if the queue is empty.\n" \
+        "inline Shd_Command_Stream* shd_queue_pop(Shd_Command_Queue* queue)\n" \
+        "{\n" \
+        "    uint32_t head = queue->head.load(std::memory_order_relaxed);\n" \
+        "    if (head == queue->tail.load(std::memory_order_acquire)) return 0;\n" \
+        "    Shd_Command_Stream* stream = queue->slots[head % SHD_COMMAND_QUEUE_SIZE];\n" \
+        "    queue->head.store(head + 1, std::memory_order_release);\n" \
+        "    return stream;\n" \
+        "}\n" \
+        "#endif\n"
+    );
 }
 
-Struct parse_as_struct(char* buffer, FILE* file, char* struct_name_start, Parse_Info parse_info)
+// A copy of contiguous bytes from a `<Block>_Source` record to a block record
+struct Pack_Move
 {
-    Struct result;
-    char *struct_name_end = strchr(struct_name_start, ' ');
-    if (struct_name_end == 0)
+    uint32_t source;
+    uint32_t target;
+    uint32_t size;
+};
+
+// Writes the vector code of a move, in chunks of 32 (with AVX), 16, 8 and 4 bytes. Nothing is read outside 
+// the source record or written outside the target record, so that every record can use it. A 12-byte vec3 is
+// moved with a 16-byte store, whose last 4 bytes land in its padding or in the next member, which is written
+// later since the moves go in increasing target order. Its load either includes the 4 bytes after it, or the
+// 4 bytes before it, which are shuffled out.
+inline void write_pack_move(Writer* body, Pack_Move move, uint32_t source_size, uint32_t stride, bool avx)
+{
+    for (; avx && move.size >= 32; move.source += 32, move.target += 32, move.size -= 32)
     {
-        struct_name_end = strchr(struct_name_start, '\n');
+        wr_format_line(body, "_mm256_storeu_ps((float*)(out + %u), _mm256_loadu_ps((const float*)(in + %u)));", 
+            move.target, move.source);
     }
-    *struct_name_end = '\0';
-
-    result.name = string_copy_with_malloc(struct_name_start);
-    // } means reached the end of struct
-    while (fgets(buffer, 1024, file) != NULL && strchr(buffer, '}') != buffer)
+    for (; move.size >= 16; move.source += 16, move.target += 16, move.size -= 16)
+    {
+        wr_format_line(body, "_mm_storeu_ps((float*)(out + %u), _mm_loadu_ps((const float*)(in + %u)));", 
+            move.target, move.source);
+    }
+    if (move.size == 12 && move.target + 16 <= stride)
     {
-        // the minimum length line would be of sorts `A a;`, which is 4 characters
-        if (strlen(buffer) < 4 || strstr(buffer, "//") == buffer)
+        if (move.source + 16 <= source_size)
         {
-            continue;
+            wr_format_line(body, "_mm_storeu_ps((float*)(out + %u), _mm_loadu_ps((const float*)(in + %u)));", 
+                move.target, move.source);
+            return;
+        }
+        if (move.source >= 4)
+        {
+            wr_format_line(body, "_mm_storeu_ps((float*)(out + %u), shd_pack_shift(_mm_loadu_ps((const float*)(in + %u))));", 
+                move.target, move.source - 4);
+            return;
         }
-        
-        result.members.push_back(parse_as_declaration(trim_front(buffer), parse_info)); 
     }
-
-    return result;
+    if (move.size >= 8)
+    {
+        wr_format_line(body, "_mm_storel_epi64((__m128i*)(out + %u), _mm_loadl_epi64((const __m128i*)(in + %u)));", 
+            move.target, move.source);
+        move.source += 8;
+        move.target += 8;
+        move.size -= 8;
+    }
+    if (move.size == 4)
+    {
+        wr_format_line(body, "memcpy(out + %u, in + %u, 4);", move.target, move.source);
+    }
 }
 
-struct Iteration_Option
+// Writes `<Block>_Source`, the tightly packed CPU-side version of the block, and 
+// `pack(const <Block>_Source* src, size_t n, void* dst)`, which scatters `n` of them into consecutive 
+// records with the padded block layout and its array stride, e.g. to upload an array of them at once.
+// A vec3 moves from 12 to 16 bytes and each column of a mat3 does the same, while members which are
+// contiguous in both layouts are moved together.
+void write_pack_kernel(Writer* wr, Writer* implementation, const std::string& type, const Uniform_Block& block)
 {
-    std::vector<const char*> input_files;
-    const char* output_file;
-    const char* output_struct_name;
-};
+    std::vector<Pack_Move> moves;
+    std::vector<uint32_t> source_offsets;
+    uint32_t source_size = 0;
+    for (size_t i = 0; i < block.members.size(); i++)
+    {
+        const auto& info = uniform_type_map[block.members[i].type];
+        source_offsets.push_back(source_size);
+        for (uint32_t column = 0; column < info.column_count; column++)
+        {
+            Pack_Move move { source_size, block.offsets[i] + column * 16, info.column_size };
+            Pack_Move* last = moves.empty() ? 0 : &moves.back();
+            if (last != 0 && last->source + last->size == move.source && last->target + last->size == move.target)
+            {
+                last->size += move.size;
+            }
+            else
+            {
+                moves.push_back(move);
+            }
+            source_size += info.column_size;
+        }
+    }
 
-struct Options
+    uint32_t stride = block_array_stride(block);
+    wr_format_line(wr, "struct %s_Source", type.c_str());
+    wr_start_struct(wr);
+    for (const auto& member : block.members)
+    {
+        wr_format_line(wr, "%s %s;", member.type, member.name);
+    }
+    wr_format_line(wr, "static constexpr size_t block_stride = %u; // the distance between the records pack() writes", stride);
+    wr_end_struct(wr);
+    // The kernel relies on the CPU types being tightly packed
+    for (size_t i = 0; i < block.members.size(); i++)
+    {
+        wr_format_line(wr, "static_assert(offsetof(%s_Source, %s) == %u, \"%s_Source::%s is not tightly packed\");", 
+            type.c_str(), block.members[i].name, source_offsets[i], type.c_str(), block.members[i].name);
+    }
+    wr_format_line(wr, "static_assert(sizeof(%s_Source) == %u, \"%s_Source is not tightly packed\");", 
+        type.c_str(), source_size, type.c_str());
+
+    Method_Target target { wr, implementation, 0 };
+    Writer* body = begin_method(&target, "pack(const %s_Source* src, size_t n, void* dst)", type.c_str());
+    wr_line(body, "const char* in = (const char*)src;");
+    wr_line(body, "char* out = (char*)dst;");
+    wr_format_line(body, "for (size_t i = 0; i < n; i++, in += %u, out += %u)", source_size, stride);
+    wr_start_block(body);
+
+    bool has_avx_moves = false;
+    for (const auto& move : moves)
+    {
+        has_avx_moves = has_avx_moves || move.size >= 32;
+    }
+    if (has_avx_moves)
+    {
+        wr_line(body, "#if defined(SHD_PACK_AVX)");
+        for (const auto& move : moves)
+        {
+            write_pack_move(body, move, source_size, stride, true);
+        }
+        wr_line(body, "#elif defined(SHD_PACK_SSE2)");
+    }
+    else
+    {
+        wr_line(body, "#if defined(SHD_PACK_SSE2)");
+    }
+    for (const auto& move : moves)
+    {
+        write_pack_move(body, move, source_size, stride, false);
+    }
+    wr_line(body, "#else");
+    for (const auto& move : moves)
+    {
+        wr_format_line(body, "memcpy(out + %u, in + %u, %u);", move.target, move.source, move.size);
+    }
+    wr_line(body, "#endif");
+
+    wr_end_block(body);
+    end_method(body);
+}
+
+void write_uniform_buffer_declaration(Writer* wr, Writer* implementation, Options* options, const std::string& type, const Uniform_Block& block)
+{
+    Backend backend = options->backend;
+
+    // wr_line(wr, "#pragma push");
+    // wr_line(wr, "#pragma pack(1)");
+    wr_format_line(wr, "struct %s", type.c_str());
+    wr_start_struct(wr);
+    // Although the padding is inserted automatically, it is arch dependent
+    // Which is why we'd better add it manually.
+    // UPDATE: pack(16) is also an option, but I'm not sure how it plays out with the opengl format.
+    {
+        uint32_t pad_count = 0;
+        for (int i = 0; i < block.members.size(); i++)
+        {
+            if (block.pad_bytes[i] > 0)
+            {
+                wr_format_line(wr, "char _padding_%u[%u];", pad_count, block.pad_bytes[i]);
+                pad_count++;
+            }
+            const auto& member = block.members[i];
+            wr_format_line(wr, "%s %s;", block_member_type(member), member.name);
+        }
+    }
+    wr_end_struct(wr);
+    // wr_line(wr, "#pragma pop");
+
+    if (options->pack_kernels)
+    {
+        write_pack_kernel(wr, implementation, type, block);
+    }
+
+    // Vulkan has no buffer wrappers, but the mirror has to match the shader layout exactly.
+    if (backend == BACKEND_VULKAN)
+    {
+        for (size_t i = 0; i < block.members.size(); i++)
+        {
+            wr_format_line(wr, "static_assert(offsetof(%s, %s) == %u, \"%s::%s does not match the shader layout\");", 
+                type.c_str(), block.members[i].name, block.offsets[i], type.c_str(), block.members[i].name);
+        }
+        return;
+    }
+
+    std::string block_name = type + "_Block";
+    Method_Target target { wr, implementation, block_name.c_str() };
+    Writer* body;
+
+    wr_format_line(wr, "struct %s", block_name.c_str());
+    wr_start_struct(wr);
+    
+    // Buffer id
+    wr_line(wr, "GLuint id;");
+    wr_line(wr, "GLuint binding_point;");
+    
+    // Create method
+    body = begin_method(&target, "create(GLuint binding_point)");
+    if (backend == BACKEND_DSA)
+    {
+        wr_line(body, "glCreateBuffers(1, &id);");
+        wr_format_line(body, "glNamedBufferData(id, %u, NULL, GL_STATIC_DRAW);", block.total_size);
+    }
+    else
+    {
+        wr_line(body, "glGenBuffers(1, &id);");
+        wr_line(body, "glBindBuffer(GL_UNIFORM_BUFFER, id);");
+        wr_format_line(body, "glBufferData(GL_UNIFORM_BUFFER, %u, NULL, GL_STATIC_DRAW);", block.total_size);
+        wr_line(body, "glBindBuffer(GL_UNIFORM_BUFFER, 0);");
+    }
+    wr_line(body, "this->binding_point = binding_point;");
+    wr_line(body, "glBindBufferBase(GL_UNIFORM_BUFFER, binding_point, id);");
+    end_method(body);
+
+    // Bind method
+    body = begin_method(&target, "bind()");
+    wr_line(body, "glBindBuffer(GL_UNIFORM_BUFFER, id);");
+    end_method(body);
+
+    if (options->stats)
+    {
+        std::vector<std::string> names { "data" };
+        for (const auto& member : block.members)
+        {
+            names.push_back(member.name);
+        }
+        wr_line(wr, "#ifdef SHD_STATS");
+        write_stats_declaration(wr, names);
+        wr_format_line(wr, "%s stats_last;", type.c_str());
+        wr_line(wr, "#endif");
+    }
+
+    // Set-all method
+    body = begin_method(&target, "data(%s* data)", type.c_str());
+    if (options->stats)
+    {
+        write_stats_record(body, 0, "stats_last", "data", "sizeof(stats_last)", "sizeof(stats_last)");
+    }
+    if (backend == BACKEND_DSA)
+    {
+        wr_format_line(body, "glNamedBufferSubData(id, 0, %u, data);", block.total_size);
+    }
+    else
+    {
+        wr_format_line(body, "glBufferData(GL_UNIFORM_BUFFER, %u, data, GL_STATIC_DRAW);", block.total_size);
+    }
+    end_method(body);
+
+    // Member offsets
+    for (int i = 0; i < block.offsets.size(); i++)
+    {
+        const auto& member = block.members[i];
+        uint32_t offset = block.offsets[i];
+        wr_format_line(wr, "const GLuint %s_offset = %u;", member.name, offset);
+    }
+
+    // Setting data
+    for (int i = 0; i < block.offsets.size(); i++)
+    {
+        const auto& member = block.members[i];
+
+        body = begin_method(&target, "%s(%s %s)", member.name, member.type, member.name);
+        // A mat3 is uploaded with its columns padded to 16 bytes
+        std::string uploaded = member.name;
+        if (uniform_type_map[member.type].block_type != 0)
+        {
+            uploaded += "_padded";
+            wr_format_line(body, "%s %s(%s);", block_member_type(member), uploaded.c_str(), member.name);
+        }
+        if (options->stats)
+        {
+            std::string last = std::string("stats_last.") + member.name;
+            std::string value = "&" + uploaded;
+            std::string size = std::to_string(uniform_type_map[{ member.type }].size_in_bytes);
+            write_stats_record(body, i + 1, last.c_str(), value.c_str(), size.c_str(), size.c_str());
+        }
+        if (backend == BACKEND_DSA)
+        {
+            wr_format_line(body, "glNamedBufferSubData(id, %s_offset, %u, glm::value_ptr(%s));", 
+                member.name, uniform_type_map[{ member.type }].size_in_bytes, uploaded.c_str());
+        }
+        else
+        {
+            wr_format_line(body, "glBufferSubData(GL_UNIFORM_BUFFER, %s_offset, %u, glm::value_ptr(%s));", 
+                member.name, uniform_type_map[{ member.type }].size_in_bytes, uploaded.c_str());
+        }
+        end_method(body);
+    }
+
+    if (options->stats)
+    {
+        write_stats_methods(&target, (int)block.members.size() + 1);
+    }
+
+    wr_end_struct(wr);
+}
+
+
+// Writes `<Block>_Batch`, which collects the block data of many draws into one big buffer, uploaded once per frame.
+// In the default mode, records are aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT and bind(i) selects the record 
+// of the i-th draw with glBindBufferRange. In the instanced mode, records are tightly packed with the std140 
+// array stride, so that the shader can declare an array of the block and index it with gl_InstanceID or gl_DrawID, 
+// after a single bind_all(). In both modes, append returns the index of the record.
+void write_batch_declaration(Writer* wr, Writer* implementation, Backend backend, const std::string& type, const Uniform_Block& block)
+{
+    std::string batch_name = type + "_Batch";
+    Method_Target target { wr, implementation, batch_name.c_str() };
+    Writer* body;
+
+    wr_format_line(wr, "struct %s", batch_name.c_str());
+    wr_start_struct(wr);
+    wr_line(wr, "GLuint id;");
+    wr_line(wr, "GLuint binding_point;");
+    wr_line(wr, "GLuint stride;");
+    wr_line(wr, "GLuint capacity;");
+    wr_line(wr, "GLuint count;");
+    wr_line(wr, "char* records;");
+
+    body = begin_method(&target, "create(GLuint binding_point, GLuint capacity, bool instanced)");
+    wr_line(body, "if (instanced)");
+    wr_start_block(body);
+    wr_format_line(body, "stride = %u;", block_array_stride(block));
+    wr_end_block(body);
+    wr_line(body, "else");
+    wr_start_block(body);
+    wr_line(body, "GLint alignment;");
+    wr_line(body, "glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);");
+    wr_format_line(body, "stride = (%u + alignment - 1) / alignment * alignment;", block_array_stride(block));
+    wr_end_block(body);
+    wr_line(body, "this->binding_point = binding_point;");
+    wr_line(body, "this->capacity = capacity;");
+    wr_line(body, "count = 0;");
+    wr_line(body, "records = (char*)malloc((size_t)stride * capacity);");
+    if (backend == BACKEND_DSA)
+    {
+        wr_line(body, "glCreateBuffers(1, &id);");
+    }
+    else
+    {
+        wr_line(body, "glGenBuffers(1, &id);");
+    }
+    end_method(body);
+
+    body = begin_method(&target, "destroy()");
+    wr_line(body, "free(records);");
+    wr_line(body, "glDeleteBuffers(1, &id);");
+    end_method(body);
+
+    // Start of a frame
+    body = begin_method(&target, "reset()");
+    wr_line(body, "count = 0;");
+    end_method(body);
+
+    body = begin_typed_method(&target, "GLuint", "append(const %s* data)", type.c_str());
+    wr_line(body, "if (count == capacity)");
+    wr_start_block(body);
+    wr_line(body, "capacity = capacity ? capacity * 2 : 64;");
+    wr_line(body, "records = (char*)realloc(records, (size_t)stride * capacity);");
+    wr_end_block(body);
+    wr_format_line(body, "memcpy(records + (size_t)stride * count, data, %u);", block.total_size);
+    wr_line(body, "return count++;");
+    end_method(body);
+
+    // The buffer is orphaned before the upload, so that the driver doesn't have to wait for the previous frame.
+    body = begin_method(&target, "upload()");
+    if (backend == BACKEND_DSA)
+    {
+        wr_line(body, "glNamedBufferData(id, (GLsizeiptr)stride * capacity, NULL, GL_STREAM_DRAW);");
+        wr_line(body, "glNamedBufferSubData(id, 0, (GLsizeiptr)stride * count, records);");
+    }
+    else
+    {
+        wr_line(body, "glBindBuffer(GL_UNIFORM_BUFFER, id);");
+        wr_line(body, "glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)stride * capacity, NULL, GL_STREAM_DRAW);");
+        wr_line(body, "glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)stride * count, records);");
+        wr_line(body, "glBindBuffer(GL_UNIFORM_BUFFER, 0);");
+    }
+    end_method(body);
+
+    // The range covers the block padded to its std140 size, which is never past the end of the record
+    body = begin_method(&target, "bind(GLuint index)");
+    wr_format_line(body, "glBindBufferRange(GL_UNIFORM_BUFFER, binding_point, id, (GLintptr)stride * index, %u);", 
+        block_array_stride(block));
+    end_method(body);
+
+    // An empty range is an error, so nothing is bound for an empty batch
+    body = begin_method(&target, "bind_all()");
+    wr_line(body, "if (count == 0) return;");
+    wr_line(body, "glBindBufferRange(GL_UNIFORM_BUFFER, binding_point, id, 0, (GLsizeiptr)stride * count);");
+    end_method(body);
+
+    wr_end_struct(wr);
+}
+
+void write_uniform_buffer_declarations(Writer* wr, Writer* implementation, Options* options)
+{
+    // Print uniform block layout types
+    for (auto const& [type, block] : uniform_blocks)
+    {   
+        write_uniform_buffer_declaration(wr, implementation, options, type, block);
+        if (options->batched_blocks.find(type) != options->batched_blocks.end())
+        {
+            write_batch_declaration(wr, implementation, options->backend, type, block);
+        }
+    }
+}
+
+inline bool is_precision_qualifier(const Token& token)
+{
+    return token_is(token, "lowp") || token_is(token, "mediump") || token_is(token, "highp");
+}
+
+// The memory qualifiers of images. They don't change how an image is set, so they are skipped.
+inline bool is_memory_qualifier(const Token& token)
+{
+    return token_is(token, "readonly") || token_is(token, "writeonly") || token_is(token, "coherent")
+        || token_is(token, "volatile") || token_is(token, "restrict");
+}
+
+// The format layout qualifiers of images, https://www.khronos.org/opengl/wiki/Layout_Qualifier_(GLSL)#Image_formats
+const char* image_formats[] = 
+{
+    "rgba32f", "rgba16f", "rg32f", "rg16f", "r11f_g11f_b10f", "r32f", "r16f",
+    "rgba16", "rgb10_a2", "rgba8", "rg16", "rg8", "r16", "r8",
+    "rgba16_snorm", "rgba8_snorm", "rg16_snorm", "rg8_snorm", "r16_snorm", "r8_snorm",
+    "rgba32i", "rgba16i", "rgba8i", "rg32i", "rg16i", "rg8i", "r32i", "r16i", "r8i",
+    "rgba32ui", "rgba16ui", "rgb10_a2ui", "rgba8ui", "rg32ui", "rg16ui", "rg8ui", "r32ui", "r16ui", "r8ui"
+};
+
+// Maps an image format layout qualifier to the GL enum, which is the same name in upper case, e.g. rgba8 to GL_RGBA8.
+// Returns null if the token isn't an image format.
+inline const char* try_map_image_format(const Token& token)
+{
+    for (const char* format : image_formats)
+    {
+        if (token_is(token, format))
+        {
+            std::string result = "GL_";
+            for (const char* c = format; *c; c++)
+            {
+                result += (char)toupper(*c);
+            }
+            return string_copy_with_malloc(result.c_str());
+        }
+    }
+    return 0;
+}
+
+inline Token expect_identifier(Scanner* scanner, const char* message)
+{
+    Token token = scan_next_token(scanner);
+    if (token.kind != TOKEN_IDENTIFIER)
+    {
+        scan_error(scanner, message, token);
+    }
+    return token;
+}
+
+inline void expect_punctuation(Scanner* scanner, char punctuation)
+{
+    Token token = scan_next_token(scanner);
+    if (!token_is(token, punctuation))
+    {
+        char message[] = "Expected ' '";
+        message[10] = punctuation;
+        scan_error(scanner, message, token);
+    }
+}
+
+// Parses `[precision|memory qualifiers] Type name;`. Sets `writeonly` when given and one of the qualifiers is writeonly.
+Uniform parse_as_declaration(Scanner* scanner, bool* writeonly = 0)
+{
+    Token type_token = expect_identifier(scanner, "Expected a type");
+    while (is_precision_qualifier(type_token) || is_memory_qualifier(type_token))
+    {
+        if (writeonly != 0 && token_is(type_token, "writeonly"))
+        {
+            *writeonly = true;
+        }
+        type_token = expect_identifier(scanner, "Expected a type");
+    }
+    Token name_token = expect_identifier(scanner, "Expected a name");
+    // TODO: add support for arrays
+    expect_punctuation(scanner, ';');
+
+    std::string type_name(type_token.start, type_token.length);
+    const char* type = try_map_type(type_name.c_str(), { scanner->path, type_token.line });
+
+    std::string name_string(name_token.start, name_token.length);
+
+    auto location = sb_create(64);
+    sb_cat(location, name_string.c_str());
+    sb_cat(location, "_location");
+
+    auto unit = sb_create(64);
+    sb_cat(unit, name_string.c_str());
+    sb_cat(unit, "_unit");
+
+    const char* name = string_copy_with_malloc(name_string.c_str());
+
+    Uniform result = { type, name, sb_build(location), sb_build(unit), 0, 0, 0, -1, -1 };
+
+    return result;
+}
+
+struct Layout_Qualifiers
+{
+    bool std140;
+    bool std430;
+    bool push_constant;
+    int set;     // -1 when not specified
+    int binding; // -1 when not specified
+    int offset;  // -1 when not specified
+    const char* image_format; // null when not specified
+};
+
+// Parses the `( ... )` after `layout`.
+Layout_Qualifiers parse_layout_qualifiers(Scanner* scanner)
+{
+    Layout_Qualifiers result { false, false, false, -1, -1, -1, 0 };
+    expect_punctuation(scanner, '(');
+    Token token;
+    Token qualifier {};
+    while (!token_is(token = scan_next_token(scanner), ')'))
+    {
+        if (token.kind == TOKEN_END)
+        {
+            scan_error(scanner, "Expected ')'", token);
+        }
+        if (token.kind == TOKEN_IDENTIFIER)
+        {
+            qualifier = token;
+            result.std140 = result.std140 || token_is(token, "std140");
+            result.std430 = result.std430 || token_is(token, "std430");
+            result.push_constant = result.push_constant || token_is(token, "push_constant");
+            if (const char* format = try_map_image_format(token))
+            {
+                result.image_format = format;
+            }
+        }
+        // `set = N`, `binding = N`, `offset = N`
+        else if (token_is(token, '='))
+        {
+            Token value = scan_next_token(scanner);
+            if (value.kind != TOKEN_NUMBER)
+            {
+                continue;
+            }
+            int number = (int)strtol(value.start, 0, 0);
+            if (token_is(qualifier, "set")) result.set = number;
+            else if (token_is(qualifier, "binding")) result.binding = number;
+            else if (token_is(qualifier, "offset")) result.offset = number;
+        }
+    }
+    return result;
+}
+
+// Parses `Name { members }`, which is the shared part of struct and uniform block definitions.
+Struct parse_as_struct(Scanner* scanner)
+{
+    Struct result;
+    Token name_token = expect_identifier(scanner, "Expected a struct or block name");
+    result.name = string_copy_with_malloc(std::string(name_token.start, name_token.length).c_str());
+
+    expect_punctuation(scanner, '{');
+    // } means reached the end of struct
+    while (!token_is(scan_peek_token(scanner), '}'))
+    {
+        // Members of push constant blocks may be placed with `layout(offset = N)`
+        int offset = -1;
+        if (token_is(scan_peek_token(scanner), "layout"))
+        {
+            scan_next_token(scanner);
+            offset = parse_layout_qualifiers(scanner).offset;
+        }
+        result.members.push_back(parse_as_declaration(scanner));
+        result.members.back().offset = offset > 0 ? (uint32_t)offset : 0;
+    }
+    scan_next_token(scanner);
+
+    return result;
+}
+
+// Uniform block layouts follow this spec for data layout: 
+// https://www.khronos.org/registry/OpenGL/extensions/ARB/ARB_uniform_buffer_object.txt
+// For the supported types, std430 (the default for push constants) gives the same offsets,
+// since it only differs from std140 for arrays and structs.
+Uniform_Block make_std140_block(std::vector<Uniform>&& members)
+{
+    Uniform_Block block;
+    block.std430 = false;
+    block.push_constant = false;
+
+    uint32_t current_offset = 0;
+    for (const auto& member : members)
+    {
+        const auto& member_type_info = uniform_type_map[{ member.type }];
+        auto member_size = member_type_info.size_in_bytes;
+        auto member_alignment = member_type_info.base_alignment;
+        auto current_alignment = current_offset % member_alignment;
+
+        // if the member is not properly aligned, do so
+        // E.g. the alignment of a float is N, so it will always fit
+        // The alignment of a vec2 is 2N, which means that if a vec2 follows a float,
+        // the float would be in the first 4 bytes, the next 4 bytes will be skipped 
+        // and then would go the vec2.
+        uint32_t skipped_bytes = current_alignment != 0 ? member_alignment - current_alignment : 0;
+
+        // An explicit offset can only move the member further
+        if (member.offset != 0)
+        {
+            if (member.offset < current_offset + skipped_bytes || member.offset % member_alignment != 0)
+            {
+                fprintf(stderr, "shd Error: The offset %u of the block member \"%s\" overlaps the previous members " \
+                    "or is not a multiple of its alignment, %u.\n", member.offset, member.name, member_alignment);
+                exit(-1);
+            }
+            skipped_bytes = member.offset - current_offset;
+        }
+        block.pad_bytes.push_back(skipped_bytes);
+        current_offset += skipped_bytes;
+        
+        block.offsets.push_back(current_offset);
+        current_offset += member_size;
+    }
+
+    block.total_size = current_offset;
+    block.members = std::move(members);
+    return block;
+}
+
+// Looks for a `// @frequency(name)` annotation in the rest of the current line. Returns null if there is none.
+const char* parse_frequency_annotation(Scanner* scanner)
+{
+    int newlines = 0;
+    const char* end = scan_find(scanner->at, scanner->end, '\n', '\n', '\n', &newlines);
+    std::string rest(scanner->at, end);
+    size_t comment = rest.find("//");
+    size_t annotation = rest.find("@frequency(", comment);
+    if (comment == std::string::npos || annotation == std::string::npos)
+    {
+        return 0;
+    }
+    size_t name_start = annotation + strlen("@frequency(");
+    size_t name_end = rest.find(')', name_start);
+    if (name_end == std::string::npos || name_end == name_start)
+    {
+        fprintf(stderr, "shd Error: Expected @frequency(name) in file %s, line %d.\n", scanner->path, scanner->line);
+        exit(-1);
+    }
+    // The name becomes part of the block name, so it has to be an identifier
+    std::string name = rest.substr(name_start, name_end - name_start);
+    bool identifier = !isdigit((unsigned char)name[0]);
+    for (char ch : name)
+    {
+        identifier = identifier && scan_is_identifier_char(ch);
+    }
+    if (!identifier)
+    {
+        fprintf(stderr, "shd Error: The frequency \"%s\" in file %s, line %d is not an identifier.\n", 
+            name.c_str(), scanner->path, scanner->line);
+        exit(-1);
+    }
+    return string_copy_with_malloc(name.c_str());
+}
+
+// Whether the scanner is at `Name {`, as opposed to `Type name;`
+inline bool is_at_block_definition(Scanner* scanner)
+{
+    Scanner lookahead = *scanner;
+    scan_next_token(&lookahead);
+    return token_is(scan_next_token(&lookahead), '{');
+}
+
+// Where a uniform block is bound in Vulkan, from its `set` and `binding` layout qualifiers
+struct Descriptor_Binding
+{
+    int set;
+    int binding;
+};
+
+// What a file declares. Structs and uniform blocks go straight into `custom_types` and `uniform_blocks`,
+// so only the loose uniforms and the names of the blocks need to be remembered.
+struct Declarations
+{
+    std::map<std::string, Uniform> uniforms;
+    std::vector<std::string> order; // the names of the uniforms in declaration order
+    std::set<std::string> blocks;
+    // Kept per program rather than in `uniform_blocks`, since programs may bind a shared block differently
+    std::map<std::string, Descriptor_Binding> bindings;
+    std::set<std::string> sources; // the paths of the file and of all the files it includes
+    // The file and line of every active declaration with a @frequency annotation, see `write_frequency_sources`
+    std::set<std::pair<std::string, int>> annotations;
+};
+
+inline void merge_declarations(Declarations& into, const Declarations& from)
+{
+    for (const auto& name : from.order)
+    {
+        if (into.uniforms.find(name) == into.uniforms.end())
+        {
+            into.order.push_back(name);
+        }
+    }
+    for (const auto& [name, u] : from.uniforms)
+    {
+        auto existing = into.uniforms.find(name);
+        if (existing != into.uniforms.end() && (existing->second.set != u.set || existing->second.binding != u.binding))
+        {
+            fprintf(stderr, "shd Error: The uniform %s is declared with set %d, binding %d and with set %d, binding %d " \
+                "in the same program.\n", name.c_str(), existing->second.set, existing->second.binding, u.set, u.binding);
+            exit(-1);
+        }
+        into.uniforms[name] = u;
+    }
+    into.blocks.insert(from.blocks.begin(), from.blocks.end());
+    for (const auto& [name, binding] : from.bindings)
+    {
+        auto existing = into.bindings.find(name);
+        if (existing != into.bindings.end() && (existing->second.set != binding.set || existing->second.binding != binding.binding))
+        {
+            fprintf(stderr, "shd Error: The uniform block %s is declared with set %d, binding %d and with set %d, binding %d " \
+                "in the same program.\n", name.c_str(), existing->second.set, existing->second.binding, binding.set, binding.binding);
+            exit(-1);
+        }
+        into.bindings[name] = binding;
+    }
+    into.sources.insert(from.sources.begin(), from.sources.end());
+    into.annotations.insert(from.annotations.begin(), from.annotations.end());
+}
+
+// Every input and included file is parsed once per run for each preprocessor state it is included in
+Pp_File_Cache<Declarations> parse_cache;
+
+void parse_file(Preprocessor* pp, const char* path, Declarations& declarations);
+
+void parse_cached(Preprocessor* pp, const std::string& path, Declarations& declarations)
+{
+    const Declarations* parsed = pp_process_cached(pp, &parse_cache, path, 
+        [](Preprocessor* pp, const std::string& path, Declarations& result)
+        {
+            parse_file(pp, string_copy_with_malloc(path.c_str()), result);
+        });
+    if (parsed != 0)
+    {
+        merge_declarations(declarations, *parsed);
+    }
+}
+
+// Whether the shaders are Vulkan GLSL, in which every uniform block is std140. Set by run() from the backend.
+bool parse_vulkan_glsl = false;
+
+// Only top-level declarations are of interest. Everything else, function bodies in particular,
+// is skipped without being tokenized.
+void parse_declarations(Scanner* scanner, Declarations& declarations)
+{
+    while (true)
+    {
+        Token token = scan_next_token(scanner);
+        if (token.kind == TOKEN_END)
+        {
+            return;
+        }
+
+        Layout_Qualifiers layout { false, false, false, -1, -1, -1, 0 };
+        if (token_is(token, "layout"))
+        {
+            layout = parse_layout_qualifiers(scanner);
+            token = scan_next_token(scanner);
+        }
+        bool writeonly = false;
+        while (is_memory_qualifier(token))
+        {
+            writeonly = writeonly || token_is(token, "writeonly");
+            token = scan_next_token(scanner);
+        }
+
+        if (token_is(token, "uniform"))
+        {
+            if (!is_at_block_definition(scanner))
+            {
+                auto uniform = parse_as_declaration(scanner, &writeonly);
+                uniform.format = layout.image_format;
+                uniform.set = layout.set;
+                uniform.binding = layout.binding;
+                uniform.frequency = parse_frequency_annotation(scanner);
+                // GLSL requires the format for images that are read. A writeonly image without one is bound
+                // with the format of the texture.
+                if (is_opaque_type(uniform.type) && opaque_types[uniform.type].image && uniform.format == 0 && !writeonly)
+                {
+                    fprintf(stderr, "shd Error: The image \"%s\" in file %s, line %d has no format layout qualifier, " \
+                        "e.g. layout(rgba8). Only writeonly images can leave it out.\n", uniform.name, scanner->path, scanner->line);
+                    exit(-1);
+                }
+                if (declarations.uniforms.find(uniform.name) == declarations.uniforms.end())
+                {
+                    declarations.order.push_back(uniform.name);
+                }
+                if (uniform.frequency != 0)
+                {
+                    declarations.annotations.insert({ scanner->path, scanner->line });
+                }
+                declarations.uniforms[{ uniform.name }] = uniform;
+            }
+            // Uniform block layout. Push constants default to std430 and, in Vulkan GLSL 
+            // (which is the only place where `set` is allowed), uniform blocks default to std140.
+            else if (layout.std140 || layout.std430 || layout.push_constant || layout.set >= 0 || parse_vulkan_glsl)
+            {
+                // 1. Process exactly as a struct
+                auto _struct = parse_as_struct(scanner);
+                for (const auto& member : _struct.members)
+                {
+                    if (is_opaque_type(member.type))
+                    {
+                        fprintf(stderr, "shd Error: The uniform block %s in file %s has the member \"%s\" of type %s. " \
+                            "Samplers and images cannot be members of uniform blocks.\n", 
+                            _struct.name, scanner->path, member.name, member.type);
+                        exit(-1);
+                    }
+                }
+                // 2. Do NOT add that data into uniform generation.
+                //    Instead, write all unique block descriptors into a separate struct, since they may be shared
+                //    between multiple shaders. That struct will have methods (or functions, I am not sure yet) for
+                //    creating and binding the buffer and for setting a value for the uniform block.
+                Uniform_Block block = make_std140_block(std::move(_struct.members));
+                block.std430 = layout.std430 || (layout.push_constant && !layout.std140);
+                block.push_constant = layout.push_constant;
+                uniform_blocks[{ _struct.name }] = std::move(block);
+                declarations.blocks.insert(_struct.name);
+                declarations.bindings[_struct.name] = { layout.set >= 0 ? layout.set : 0, layout.binding >= 0 ? layout.binding : 0 };
+                // The optional instance name and the semicolon
+                scan_skip_statement(scanner);
+            }
+            // Blocks with the shared or packed layouts have implementation defined offsets
+            else
+            {
+                scan_skip_statement(scanner);
+                scan_skip_statement(scanner);
+            }
+        }
+        // custom struct definition
+        else if (token_is(token, "struct"))
+        {
+            auto _struct = parse_as_struct(scanner);
+            // TODO: Check if the members are the same. 
+            // If not, notify the user that different structs with same name are not allowed.
+            custom_types[{ _struct.name }] = std::move(_struct.members);
+            scan_skip_statement(scanner);
+        }
+        else if (token_is(token, '{'))
+        {
+            scan_skip_braces(scanner);
+        }
+        else if (!token_is(token, ';') && !token_is(token, '}'))
+        {
+            scan_skip_statement(scanner);
+        }
+    }
+}
+
+void parse_file(Preprocessor* pp, const char* path, Declarations& declarations)
+{
+    declarations.sources.insert(path);
+    Pp_Source source = pp_open(path);
+    std::string line;
+    std::string include_path;
+
+    // The active lines are collected and scanned in one go, up to the next #include.
+    // Lines consumed by the preprocessor are kept as empty lines, so that line numbers stay correct.
+    std::string text;
+    int text_first_line = 1;
+    int text_newlines = 0;
+
+    while (true)
+    {
+        Pp_Line_Kind kind = pp_next_line(pp, &source, &line, &include_path);
+        if (kind == PP_LINE)
+        {
+            while (text_first_line + text_newlines < source.line)
+            {
+                text += '\n';
+                text_newlines++;
+            }
+            text += line;
+            text_newlines += text.back() == '\n';
+            continue;
+        }
+
+        Scanner scanner = scan_create(text.data(), text.size(), path);
+        scanner.line = text_first_line;
+        parse_declarations(&scanner, declarations);
+        text.clear();
+        text_first_line = source.line + 1;
+        text_newlines = 0;
+
+        if (kind == PP_END)
+        {
+            break;
+        }
+        parse_cached(pp, include_path, declarations);
+    }
+    pp_close(&source);
+}
+
+// The Vulkan shader stage of an input file, guessed from its extension.
+const char* shader_stage_flag(const char* path)
+{
+    const char* extension = strrchr(path, '.');
+    if (extension == 0)
+    {
+        return "VK_SHADER_STAGE_ALL";
+    }
+    extension++;
+    if (strcmp(extension, "vs") == 0 || strcmp(extension, "vert") == 0) return "VK_SHADER_STAGE_VERTEX_BIT";
+    if (strcmp(extension, "fs") == 0 || strcmp(extension, "frag") == 0) return "VK_SHADER_STAGE_FRAGMENT_BIT";
+    if (strcmp(extension, "gs") == 0 || strcmp(extension, "geom") == 0) return "VK_SHADER_STAGE_GEOMETRY_BIT";
+    if (strcmp(extension, "tcs") == 0 || strcmp(extension, "tesc") == 0) return "VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT";
+    if (strcmp(extension, "tes") == 0 || strcmp(extension, "tese") == 0) return "VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT";
+    if (strcmp(extension, "cs") == 0 || strcmp(extension, "comp") == 0) return "VK_SHADER_STAGE_COMPUTE_BIT";
+    return "VK_SHADER_STAGE_ALL";
+}
+
+inline std::string join_stage_flags(const std::set<std::string>& stages)
+{
+    std::string result;
+    for (const auto& stage : stages)
+    {
+        if (!result.empty())
+        {
+            result += " | ";
+        }
+        result += stage;
+    }
+    return result;
+}
+
+// The descriptor type of a sampler or an image
+inline const char* vulkan_descriptor_type(const char* type)
+{
+    const auto& info = opaque_types[type];
+    if (strcmp(info.target, "GL_TEXTURE_BUFFER") == 0)
+    {
+        return info.image ? "VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER" : "VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER";
+    }
+    return info.image ? "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE" : "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER";
+}
+
+inline void write_vulkan_header(Writer* writer)
+{
+    wr_puts(writer,
+        "#pragma once\n" \
+        "// Warning: This file has been autogenerated by the tool!\n"\
+        "#include <stddef.h>\n" \
+        "#include <glm/glm.hpp>\n" \
+        "#include <vulkan/vulkan.h>\n"
+    );
+}
+
+// Writes the `<Name>_Layout` struct, which fixes the per-draw data layout of the program at build time:
+// the push constant ranges, a helper to push each push constant block and the descriptor set layout 
+// bindings of the uniform blocks, grouped by set.
+void write_vulkan_program(Writer* wr, Options* options, Iteration_Option* iteration_option,
+    const Declarations& declarations, const std::map<std::string, std::set<std::string>>& stages)
+{
+    // Samplers and images are the only loose uniforms Vulkan has
+    for (const auto& [name, u] : declarations.uniforms)
+    {
+        if (!is_opaque_type(u.type))
+        {
+            fprintf(stderr, "shd Error: Vulkan does not support loose uniforms, but %s declares \"%s\". " \
+                "Move it into a uniform or push constant block.\n", iteration_option->output_file, u.name);
+            exit(-1);
+        }
+    }
+
+    write_vulkan_header(wr);
+    wr_format_line(wr, "#include \"%s\"", options->custom_types_file);
+    wr_format_line(wr, "#include \"%s\"", options->uniform_buffer_file);
+
+    wr_format_line(wr, "struct %s_Layout", iteration_option->output_struct_name);
+    wr_start_struct(wr);
+
+    // Push constants. A block shared by several stages is one range. Blocks of different stages share
+    // the push constant memory, so they must not overlap: the members of the later ones are placed with 
+    // `layout(offset = N)`, and the range starts at the first member.
+    std::vector<std::pair<uint32_t, std::string>> push_constants; // by start offset
+    for (const auto& type : declarations.blocks)
+    {
+        const auto& block = uniform_blocks[type];
+        if (block.push_constant)
+        {
+            push_constants.push_back({ block.offsets.empty() ? 0 : block.offsets[0], type });
+        }
+    }
+    std::sort(push_constants.begin(), push_constants.end());
+
+    int push_constant_count = 0;
+    uint32_t previous_end = 0;
+    const char* previous_type = 0;
+    for (const auto& [start, type] : push_constants)
+    {
+        const auto& block = uniform_blocks[type];
+        if (previous_type != 0 && start < previous_end)
+        {
+            fprintf(stderr, "shd Error: The push constant blocks %s and %s of %s overlap. " \
+                "Place the first member of %s at layout(offset = %u) or later.\n", 
+                previous_type, type.c_str(), iteration_option->output_file, type.c_str(), (previous_end + 15) & ~15u);
+            exit(-1);
+        }
+        // Push constant ranges must have a size that is a multiple of 4
+        uint32_t size = ((block.total_size + 3) & ~3u) - start;
+        wr_format_line(wr, "static constexpr VkPushConstantRange %s_range = { %s, %u, %u };", 
+            type.c_str(), join_stage_flags(stages.at(type)).c_str(), start, size);
+        wr_format_line(wr, "static inline void push(VkCommandBuffer command_buffer, VkPipelineLayout layout, const %s& data)", type.c_str());
+        wr_start_block(wr);
+        wr_format_line(wr, "vkCmdPushConstants(command_buffer, layout, %s_range.stageFlags, %u, %u, (const char*)&data + %u);", 
+            type.c_str(), start, block.total_size - start, start);
+        wr_end_block(wr);
+        push_constant_count++;
+        previous_end = start + size;
+        previous_type = type.c_str();
+    }
+
+    if (push_constant_count > 0)
+    {
+        wr_line(wr, "static constexpr VkPushConstantRange push_constant_ranges[] =");
+        wr_start_block(wr);
+        for (const auto& [_, type] : push_constants)
+        {
+            wr_format_line(wr, "%s_range,", type.c_str());
+        }
+        wr_end_struct(wr);
+    }
+    wr_format_line(wr, "static constexpr uint32_t push_constant_range_count = %d;", push_constant_count);
+
+    // Descriptor set layouts, of the uniform blocks and of the samplers and images
+    struct Descriptor
+    {
+        int binding;
+        const char* type;
+        std::string name;
+    };
+    std::map<int, std::vector<Descriptor>> sets;
+    for (const auto& type : declarations.blocks)
+    {
+        if (!uniform_blocks[type].push_constant)
+        {
+            const auto& binding = declarations.bindings.at(type);
+            sets[binding.set].push_back({ binding.binding, "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER", type });
+        }
+    }
+    for (const auto& [name, u] : declarations.uniforms)
+    {
+        sets[u.set >= 0 ? u.set : 0].push_back({ u.binding >= 0 ? u.binding : 0, vulkan_descriptor_type(u.type), name });
+    }
+    for (auto& [set, descriptors] : sets)
+    {
+        std::sort(descriptors.begin(), descriptors.end(), 
+            [](const Descriptor& a, const Descriptor& b) { return a.binding < b.binding; });
+        for (size_t i = 1; i < descriptors.size(); i++)
+        {
+            if (descriptors[i].binding == descriptors[i - 1].binding)
+            {
+                fprintf(stderr, "shd Error: %s and %s of %s are both bound to set %d, binding %d. " \
+                    "Give each of them its own layout(binding = N).\n", descriptors[i - 1].name.c_str(), 
+                    descriptors[i].name.c_str(), iteration_option->output_file, set, descriptors[i].binding);
+                exit(-1);
+            }
+        }
+
+        wr_format_line(wr, "static constexpr VkDescriptorSetLayoutBinding set_%d_bindings[] =", set);
+        wr_start_block(wr);
+        for (const auto& descriptor : descriptors)
+        {
+            wr_format_line(wr, "{ %d, %s, 1, %s, nullptr }, // %s", descriptor.binding, descriptor.type,
+                join_stage_flags(stages.at(descriptor.name)).c_str(), descriptor.name.c_str());
+        }
+        wr_end_struct(wr);
+        wr_format_line(wr, "static constexpr uint32_t set_%d_binding_count = %d;", set, (int)descriptors.size());
+    }
+
+    wr_end_struct(wr);
+}
+
+// 64-bit FNV-1a
+inline uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// The key of the program binary cache: the generator version, the macros and the contents of
+// every source file of the program, including the included ones.
+uint64_t hash_program_sources(const Declarations& declarations, const std::map<std::string, Pp_Macro>& defines)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hash_bytes(hash, SHD_GENERATOR_VERSION, strlen(SHD_GENERATOR_VERSION));
+    std::string serialized_defines = pp_serialize_defines(defines);
+    hash = hash_bytes(hash, serialized_defines.data(), serialized_defines.size());
+
+    char buffer[4096];
+    for (const auto& path : declarations.sources)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == 0)
+        {
+            fprintf(stderr, "shd Error: Could not open the file %s.\n", path.c_str());
+            exit(-1);
+        }
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            hash = hash_bytes(hash, buffer, size);
+        }
+        fclose(file);
+    }
+    return hash;
+}
+
+// Writes `load_or_link()`, which loads the program from a binary cached by glGetProgramBinary, and falls back
+// to linking it when the binary is missing, was cached for other sources or is rejected by the driver
+// (e.g. after a driver update). The callback attaches the compiled shaders to the program, which is then linked
+// and cached. Either way, the locations are queried.
+void write_load_or_link(Method_Target* target, uint64_t source_hash)
+{
+    wr_format_line(target->header, "static const unsigned long long source_hash = 0x%016llxull;", (unsigned long long)source_hash);
+
+    Writer* body = begin_typed_method(target, "bool", "load_or_link(const char* cache_path, void (*attach_shaders)(GLuint program))");
+    wr_line(body, "unsigned long long hash = source_hash;");
+    wr_line(body, "GLenum format = 0;");
+    wr_line(body, "GLint length = 0;");
+    wr_line(body, "GLint status = GL_FALSE;");
+    wr_line(body, "FILE* file = fopen(cache_path, \"rb\");");
+    wr_line(body, "if (file != NULL)");
+    wr_start_block(body);
+    wr_line(body, "unsigned long long cached_hash = 0;");
+    wr_line(body, "bool valid = fread(&cached_hash, sizeof(cached_hash), 1, file) == 1 && cached_hash == hash");
+    wr_line(body, "    && fread(&format, sizeof(format), 1, file) == 1 && fread(&length, sizeof(length), 1, file) == 1 && length > 0;");
+    wr_line(body, "void* binary = valid ? malloc(length) : NULL;");
+    wr_line(body, "valid = valid && fread(binary, 1, length, file) == (size_t)length;");
+    wr_line(body, "fclose(file);");
+    wr_line(body, "if (valid)");
+    wr_start_block(body);
+    wr_line(body, "id = glCreateProgram();");
+    wr_line(body, "glProgramBinary(id, format, binary, length);");
+    wr_line(body, "glGetProgramiv(id, GL_LINK_STATUS, &status);");
+    wr_line(body, "if (status == GL_TRUE)");
+    wr_start_block(body);
+    wr_line(body, "free(binary);");
+    wr_line(body, "query_locations();");
+    wr_line(body, "return true;");
+    wr_end_block(body);
+    wr_line(body, "glDeleteProgram(id);");
+    wr_end_block(body);
+    wr_line(body, "free(binary);");
+    wr_end_block(body);
+
+    wr_line(body, "id = glCreateProgram();");
+    wr_line(body, "glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);");
+    wr_line(body, "attach_shaders(id);");
+    wr_line(body, "glLinkProgram(id);");
+    wr_line(body, "glGetProgramiv(id, GL_LINK_STATUS, &status);");
+    wr_line(body, "if (status != GL_TRUE)");
+    wr_start_block(body);
+    wr_line(body, "glDeleteProgram(id);");
+    wr_line(body, "id = 0;");
+    wr_line(body, "return false;");
+    wr_end_block(body);
+    wr_line(body, "query_locations();");
+
+    wr_line(body, "glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);");
+    wr_line(body, "if (length > 0 && (file = fopen(cache_path, \"wb\")) != NULL)");
+    wr_start_block(body);
+    wr_line(body, "void* binary = malloc(length);");
+    wr_line(body, "glGetProgramBinary(id, length, NULL, &format, binary);");
+    wr_line(body, "fwrite(&hash, sizeof(hash), 1, file);");
+    wr_line(body, "fwrite(&format, sizeof(format), 1, file);");
+    wr_line(body, "fwrite(&length, sizeof(length), 1, file);");
+    wr_line(body, "fwrite(binary, 1, length, file);");
+    wr_line(body, "fclose(file);");
+    wr_line(body, "free(binary);");
+    wr_end_block(body);
+    wr_line(body, "return true;");
+    end_method(body);
+}
+
+// Replays the commands of a stream from `at` up to and including the next `end_draw()`, and returns
+// where the next draw starts. Each command calls the setter it was recorded from.
+void write_replay(Method_Target* target, Options* options, const std::map<std::string, Uniform>& uniforms)
+{
+    Writer* body = begin_typed_method(target, "size_t", "replay(const Shd_Command_Stream* stream, size_t at)");
+    wr_line(body, "while (at < stream->size)");
+    wr_start_block(body);
+    wr_line(body, "Shd_Command command;");
+    wr_line(body, "memcpy(&command, stream->data + at, sizeof(command));");
+    wr_line(body, "const char* value = stream->data + at + sizeof(command);");
+    wr_line(body, "at += sizeof(command) + command.size;");
+    wr_line(body, "switch (command.opcode)");
+    wr_start_block(body);
+    int opcode = 0;
+    for (const auto& [_, u] : uniforms)
+    {
+        wr_format_line(body, "case %d:", opcode++);
+        wr_start_block(body);
+        wr_format_line(body, "%s v;", parameter_type(options, u));
+        wr_line(body, "memcpy(&v, value, sizeof(v));");
+        wr_format_line(body, "%s(v);", u.name);
+        wr_line(body, "break;");
+        wr_end_block(body);
+    }
+    wr_line(body, "case SHD_END_DRAW:");
+    wr_line(body, "    return at;");
+    wr_end_block(body);
+    wr_end_block(body);
+    wr_line(body, "return at;");
+    end_method(body);
+}
+
+// Writes `<Name>_Recorder`, which has the same setters as the program, but only records the calls into a stream.
+// It doesn't use GL, so any thread can use it.
+void write_recorder(Writer* wr, Writer* implementation, Options* options, const char* name, const std::map<std::string, Uniform>& uniforms)
+{
+    std::string recorder_name = name;
+    recorder_name += "_Recorder";
+    Method_Target target { wr, implementation, recorder_name.c_str() };
+    Writer* body;
+
+    wr_format_line(wr, "struct %s", recorder_name.c_str());
+    wr_start_struct(wr);
+    wr_line(wr, "Shd_Command_Stream* stream;");
+
+    int opcode = 0;
+    for (const auto& [_, u] : uniforms)
+    {
+        body = begin_method(&target, "%s(%s %s)", u.name, parameter_type(options, u), u.name);
+        wr_format_line(body, "shd_record_command(stream, %d, &%s, sizeof(%s));", opcode++, u.name, u.name);
+        end_method(body);
+    }
+
+    body = begin_method(&target, "end_draw()");
+    wr_line(body, "shd_record_command(stream, SHD_END_DRAW, 0, 0);");
+    end_method(body);
+
+    wr_end_struct(wr);
+}
+
+// The GLSL name of a mapped type, e.g. `vec3` for `glm::vec3`.
+inline const char* glsl_type_name(const char* type)
+{
+    for (const auto& [glsl_type, mapped_type] : glsl_to_uniform_type_map)
+    {
+        if (strcmp(mapped_type, type) == 0)
+        {
+            return glsl_type.c_str();
+        }
+    }
+    return type;
+}
+
+// The name of the block synthesized for a frequency, e.g. `Example_Frame` for `frame` in example.h.
+inline std::string frequency_block_name(Iteration_Option* iteration_option, const char* frequency)
+{
+    std::string name = iteration_option->output_struct_name;
+    name += '_';
+    name += frequency;
+    name[strlen(iteration_option->output_struct_name) + 1] = (char)toupper(frequency[0]);
+    return name;
+}
+
+// Moves the loose uniforms annotated with `// @frequency(name)` into one synthesized block per frequency,
+// laid out exactly like a `layout (std140) uniform` block, so that each group is uploaded with a single
+// buffer update instead of a glUniform call per uniform. Returns the members of each block by its name,
+// in declaration order.
+std::map<std::string, std::vector<Uniform>> group_by_frequency(Iteration_Option* iteration_option, Declarations& declarations)
+{
+    std::map<std::string, std::vector<Uniform>> groups;
+    for (const auto& name : declarations.order)
+    {
+        auto it = declarations.uniforms.find(name);
+        if (it == declarations.uniforms.end() || it->second.frequency == 0)
+        {
+            continue;
+        }
+        const Uniform& u = it->second;
+        if (uniform_type_map.find(u.type) == uniform_type_map.end())
+        {
+            fprintf(stderr, "shd Error: The uniform \"%s\" of type %s has a @frequency annotation, " \
+                "but only uniforms of the basic types can be grouped into blocks.\n", u.name, u.type);
+            exit(-1);
+        }
+        groups[frequency_block_name(iteration_option, u.frequency)].push_back(u);
+        declarations.uniforms.erase(it);
+    }
+
+    for (const auto& [name, members] : groups)
+    {
+        if (uniform_blocks.find(name) != uniform_blocks.end())
+        {
+            fprintf(stderr, "shd Error: The uniform block %s, synthesized from @frequency annotations, " \
+                "has the same name as another uniform block.\n", name.c_str());
+            exit(-1);
+        }
+        std::vector<Uniform> block_members = members;
+        uniform_blocks[name] = make_std140_block(std::move(block_members));
+        declarations.blocks.insert(name);
+    }
+    return groups;
+}
+
+// Where the rewritten copy of an input goes, e.g. shaders/mesh.example.vert for shaders/mesh.vert and example.h.
+// It stays next to the input, so that relative includes keep working.
+std::string frequency_source_path(const char* input_file, const char* output_file)
+{
+    const char* output_name = max({ strrchr(output_file, '/') + 1, strrchr(output_file, '\\') + 1, output_file });
+    std::string output_stem(output_name, strcspn(output_name, "."));
+
+    std::string path = input_file;
+    size_t name_start = path.find_last_of("/\\");
+    name_start = name_start == std::string::npos ? 0 : name_start + 1;
+    size_t extension = path.find('.', name_start);
+    if (extension == std::string::npos)
+    {
+        return path + "." + output_stem;
+    }
+    return path.substr(0, extension) + "." + output_stem + path.substr(extension);
+}
+
+// Reads the whole file into `text`. Returns false if it cannot be opened.
+inline bool read_text_file(const char* path, std::string& text)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == 0)
+    {
+        return false;
+    }
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        text.append(buffer, size);
+    }
+    fclose(file);
+    return true;
+}
+
+// The rewritten copies written so far, see `write_frequency_sources`
+std::set<std::string> frequency_sources;
+
+// The rewritten copies are outputs too, but whether an input has annotations is only known once it is parsed.
+// Exits if the copy would overwrite an input, another output or the copy of another input.
+void check_frequency_source(Options* options, const std::string& path)
+{
+    bool conflict = !frequency_sources.insert(path).second || path == options->custom_types_file 
+        || path == options->uniform_buffer_file
+        || (options->implementation_file != 0 && path == options->implementation_file);
+    for (const auto& option : options->iteration_options)
+    {
+        conflict = conflict || path == option.output_file;
+        for (auto input_file : option.input_files)
+        {
+            conflict = conflict || path == input_file;
+        }
+    }
+    if (conflict)
+    {
+        fprintf(stderr, "shd Error: The rewritten copy %s of an input with @frequency annotations would overwrite " \
+            "another input or output.\n", path.c_str());
+        exit(-1);
+    }
+}
+
+// Writes a copy of each input in which the annotated declarations are replaced by the synthesized blocks.
+// In each file, the first annotated declaration of a block becomes the declaration of the whole block and 
+// the others are removed, which keeps the line numbers. Each stage declares the whole block, so that the 
+// layout is the same in all of them. Only the declarations the preprocessor kept are replaced, so the block
+// is declared in the active branch of an #ifdef.
+void write_frequency_sources(Options* options, Iteration_Option* iteration_option, const Declarations& declarations,
+    const std::map<std::string, std::vector<Uniform>>& groups)
+{
+    std::map<std::string, std::string> block_of_uniform;
+    std::map<std::string, std::string> block_declarations;
+    for (const auto& [name, members] : groups)
+    {
+        std::string declaration = "layout (std140) uniform " + name + " {";
+        for (const auto& member : members)
+        {
+            declaration += ' ';
+            declaration += glsl_type_name(member.type);
+            declaration += ' ';
+            declaration += member.name;
+            declaration += ';';
+            block_of_uniform[member.name] = name;
+        }
+        declaration += " };";
+        block_declarations[name] = declaration;
+    }
+
+    std::set<std::string> replaced;
+    // The same input may be listed twice in a group, but its copy is written once
+    std::set<std::string> rewritten;
+    for (auto input_file : iteration_option->input_files)
+    {
+        if (!rewritten.insert(input_file).second)
+        {
+            continue;
+        }
+        std::string text;
+        if (!read_text_file(input_file, text))
+        {
+            fprintf(stderr, "shd Error: Could not open the file %s.\n", input_file);
+            exit(-1);
+        }
+
+        std::string output;
+        std::set<std::string> declared;
+        bool changed = false;
+        size_t line_start = 0;
+        int line_number = 0;
+        while (line_start < text.size())
+        {
+            size_t line_end = text.find('\n', line_start);
+            line_end = line_end == std::string::npos ? text.size() : line_end + 1;
+            std::string line = text.substr(line_start, line_end - line_start);
+            line_start = line_end;
+            line_number++;
+            if (declarations.annotations.find({ input_file, line_number }) == declarations.annotations.end())
+            {
+                output += line;
+                continue;
+            }
+
+            // The name is the identifier before the `;`, which comes before the annotation comment
+            size_t comment = line.find("//");
+            size_t semicolon = line.rfind(';', comment);
+            if (semicolon == std::string::npos)
+            {
+                output += line;
+                continue;
+            }
+            size_t name_end = line.find_last_not_of(" \t", semicolon - 1) + 1;
+            size_t name_start = name_end;
+            while (name_start > 0 && scan_is_identifier_char(line[name_start - 1]))
+            {
+                name_start--;
+            }
+            auto block = block_of_uniform.find(line.substr(name_start, name_end - name_start));
+            if (block == block_of_uniform.end())
+            {
+                output += line;
+                continue;
+            }
+
+            changed = true;
+            replaced.insert(block->first);
+            if (declared.insert(block->second).second)
+            {
+                output += block_declarations[block->second];
+            }
+            output += '\n';
+        }
+
+        if (changed)
+        {
+            std::string path = frequency_source_path(input_file, iteration_option->output_file);
+            check_frequency_source(options, path);
+            FILE* file = fopen(path.c_str(), "wb");
+            if (file == 0)
+            {
+                fprintf(stderr, "shd Error: Could not write the file %s.\n", path.c_str());
+                exit(-1);
+            }
+            fwrite(output.data(), 1, output.size(), file);
+            fclose(file);
+        }
+    }
+
+    for (const auto& [name, _] : block_of_uniform)
+    {
+        if (replaced.find(name) == replaced.end())
+        {
+            fprintf(stderr, "shd Error: The uniform \"%s\" with a @frequency annotation has to be declared " \
+                "on a single line of an input file, not in an included file.\n", name.c_str());
+            exit(-1);
+        }
+    }
+}
+
+void run_iteration(Options* options, Iteration_Option* iteration_option, Writer* implementation)
+{
+    Declarations declarations;
+    // The shader stages each uniform block, sampler and image is used in. GLSL does not allow a block and 
+    // a variable to have the same name, so they can share the map.
+    std::map<std::string, std::set<std::string>> stages;
+
+    std::map<std::string, Pp_Macro> defines = options->defines;
+    for (const auto& [name, macro] : iteration_option->defines)
+    {
+        defines[name] = macro;
+    }
+
+    for (auto input_file : iteration_option->input_files)
+    {
+        // Each stage is compiled on its own, so every input starts with the macros of its group and with
+        // no #pragma once files included. The parse cache is still shared.
+        Preprocessor preprocessor;
+        preprocessor.include_paths = options->include_paths;
+        preprocessor.defines = defines;
+        Declarations input_declarations;
+        parse_cached(&preprocessor, input_file, input_declarations);
+        for (const auto& type : input_declarations.blocks)
+        {
+            stages[type].insert(shader_stage_flag(input_file));
+        }
+        for (const auto& [name, u] : input_declarations.uniforms)
+        {
+            stages[name].insert(shader_stage_flag(input_file));
+        }
+        merge_declarations(declarations, input_declarations);
+    }
+
+    // Vulkan has no loose uniforms to begin with
+    if (options->backend != BACKEND_VULKAN)
+    {
+        auto groups = group_by_frequency(iteration_option, declarations);
+        if (!groups.empty())
+        {
+            write_frequency_sources(options, iteration_option, declarations, groups);
+        }
+    }
+    const auto& uniforms = declarations.uniforms;
+
+    Writer writer;
+    writer.stream = fopen(iteration_option->output_file, "w+");
+    writer.current_indentation_level = 0;
+    writer.spaces_per_tab = options->spaces_per_tab;
+    Writer *wr = &writer;
+
+    if (options->backend == BACKEND_VULKAN)
+    {
+        write_vulkan_program(wr, options, iteration_option, declarations, stages);
+        fclose(writer.stream);
+        return;
+    }
+
+    std::string struct_name = iteration_option->output_struct_name;
+    struct_name += "_Program";
+    Method_Target target { wr, implementation, struct_name.c_str() };
+    Writer* body;
+    
+    if (implementation == 0)
+    {
+        write_header(wr, options);
+        wr_format_line(wr, "#include \"%s\"", options->custom_types_file);
+        wr_format_line(wr, "#include \"%s\"", options->uniform_buffer_file);
+    }
+    else
+    {
+        write_lean_header(wr, options);
+        std::set<std::string> forward_declared;
+        for (const auto& [_, u] : uniforms)
+        {
+            if (custom_types.find(u.type) != custom_types.end() && forward_declared.insert(u.type).second)
+            {
+                wr_format_line(wr, "struct %s;", u.type);
+            }
+        }
+        for (auto const& type : declarations.blocks)
+        {
+            wr_format_line(wr, "struct %s_Block;", type.c_str());
+            if (options->batched_blocks.find(type) != options->batched_blocks.end())
+            {
+                wr_format_line(wr, "struct %s_Batch;", type.c_str());
+            }
+        }
+        // The copies of the last values need the complete types
+        if (options->stats)
+        {
+            wr_line(wr, "#ifdef SHD_STATS");
+            wr_line(wr, "#include <glm/glm.hpp>");
+            wr_format_line(wr, "#include \"%s\"", options->custom_types_file);
+            wr_line(wr, "#endif");
+        }
+    }
+    if (options->stats)
+    {
+        write_stats_preamble(wr);
+    }
+    if (options->record)
+    {
+        write_record_preamble(wr);
+    }
+    if (options->binary_cache && implementation == 0)
+    {
+        wr_line(wr, "#include <stdio.h>");
+        wr_line(wr, "#include <stdlib.h>");
+    }
+
+    wr_format_line(wr, "struct %s", struct_name.c_str());
+    wr_start_struct(wr);
+    wr_line(wr, "GLuint id;");
+    body = begin_method(&target, "use()");
+    wr_line(body, "glUseProgram(id);");
+    end_method(body);
+        
+    // Location declarations
+    for (const auto& [_, u] : uniforms)
+    {
+        write_location_declaration(wr, u);
+    }
+
+    // Uniform blocks indices
+    for (auto const& type : declarations.blocks)
+    {
+        wr_format_line(wr, "GLint %s_block_index;", type.c_str());  
+    }
+
+    // Texture and image units
+    Unit_Numbering units { {}, { 0, 0 }, 0 };
+    if (!options->bindless_textures)
+    {
+        for (const auto& [_, u] : uniforms)
+        {
+            if (is_opaque_type(u.type) && u.binding >= 0)
+            {
+                units.explicit_units[opaque_types[u.type].image ? 1 : 0].insert(u.binding);
+            }
+        }
+        for (const auto& name : declarations.order)
+        {
+            auto u = uniforms.find(name);
+            if (u != uniforms.end())
+            {
+                write_unit_declaration(wr, u->second, &units);
+            }
+        }
+    }
+
+    // Active uniforms, one bit per setter. A uniform the linker removed has no location,
+    // so its setter returns right away.
+    int active_words = ((int)uniforms.size() + 31) / 32;
+    if (active_words > 0)
+    {
+        wr_format_line(wr, "GLuint active[%d];", active_words);
+    }
+
+    // Instrumentation, the first entry counts the calls of uniforms()
+    if (options->stats)
+    {
+        std::vector<std::string> names { "uniforms()" };
+        wr_line(wr, "#ifdef SHD_STATS");
+        for (const auto& [_, u] : uniforms)
+        {
+            wr_format_line(wr, "%s %s_last;", parameter_type(options, u), u.name);
+            names.push_back(u.name);
+        }
+        write_stats_declaration(wr, names);
+        wr_line(wr, "#endif");
+    }
+
+    // Uniform setters
+    int stats_index = 1;
+    int active_bit = 0;
+    for (const auto& [_, u] : uniforms)
+    {
+        body = begin_method(&target, "%s(%s %s)", u.name, parameter_type(options, u), u.name);
+        wr_format_line(body, "if (!(active[%d] & (1u << %d))) return;", active_bit / 32, active_bit % 32);
+        active_bit++;
+        if (options->stats)
+        {
+            std::string last = std::string(u.name) + "_last";
+            std::string value = std::string("&") + u.name;
+            std::string size = std::string("sizeof(") + u.name + ")";
+            // Binding a texture uploads nothing
+            const char* bytes = is_opaque_type(u.type) ? "0" : size.c_str();
+            write_stats_record(body, stats_index++, last.c_str(), value.c_str(), size.c_str(), bytes);
+        }
+        write_uniform(body, options, u);
+        end_method(body);
+    }
+
+    // Uniform block setters.
+    for (auto const& type : declarations.blocks)
+    {
+        body = begin_method(&target, "%s_block(%s_Block %s_block)", type.c_str(), type.c_str(), type.c_str());
+        wr_format_line(body, "glUniformBlockBinding(id, %s_block_index, %s_block.binding_point);", type.c_str(), type.c_str());
+        end_method(body);
+        if (options->batched_blocks.find(type) != options->batched_blocks.end())
+        {
+            body = begin_method(&target, "%s_block(const %s_Batch& %s_batch)", type.c_str(), type.c_str(), type.c_str());
+            wr_format_line(body, "glUniformBlockBinding(id, %s_block_index, %s_batch.binding_point);", type.c_str(), type.c_str());
+            end_method(body);
+        }
+    }
+
+    // Initializing locations
+    body = begin_method(&target, "query_locations()");
+
+    for (const auto& [_, u] : uniforms)
+    {
+        write_location(body, u);
+    }
+
+    for (int i = 0; i < active_words; i++)
+    {
+        wr_format_line(body, "active[%d] = 0;", i);
+    }
+    active_bit = 0;
+    for (const auto& [_, u] : uniforms)
+    {
+        std::vector<std::string> locations;
+        collect_locations(u, locations);
+        std::string condition;
+        for (const auto& location : locations)
+        {
+            if (!condition.empty())
+            {
+                condition += " || ";
+            }
+            condition += location + " != -1";
+        }
+        wr_format_line(body, "if (%s) active[%d] |= 1u << %d;", condition.c_str(), active_bit / 32, active_bit % 32);
+        active_bit++;
+    }
+
+    // Samplers and images keep their units, so they are only set once. Without DSA, the program has to be
+    // current for that, so the previous one is restored afterwards.
+    if (units.count > 0)
+    {
+        if (options->backend == BACKEND_GL)
+        {
+            wr_line(body, "GLint previous_program;");
+            wr_line(body, "glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);");
+            wr_line(body, "glUseProgram(id);");
+        }
+        for (const auto& name : declarations.order)
+        {
+            auto u = uniforms.find(name);
+            if (u != uniforms.end())
+            {
+                write_unit_assignment(body, options->backend, u->second);
+            }
+        }
+        if (options->backend == BACKEND_GL)
+        {
+            wr_line(body, "glUseProgram(previous_program);");
+        }
+    }
+
+    // Getting the indices for uniform blocks.
+    for (const auto& type : declarations.blocks)
+    {
+        wr_format_line(body, "%s_block_index = glGetUniformBlockIndex(id, \"%s\");", type.c_str(), type.c_str());
+    }
+    
+    end_method(body);
+
+    // Setting all uniforms. The function header.
+    // Vectors, matrices and structs are taken by reference, so that nothing is copied for removed uniforms
+    std::string parameters;
+    for (const auto& [_, u] : uniforms)
+    {
+        if (!parameters.empty())
+        {
+            parameters += ", ";
+        }
+        bool by_value = is_opaque_type(u.type) || strcmp(u.type, "glm::float32") == 0;
+        parameters += by_value ? "" : "const ";
+        parameters += parameter_type(options, u);
+        parameters += by_value ? " " : "& ";
+        parameters += u.name;
+        parameters += "_v";
+    }
+
+    body = begin_method(&target, "uniforms(%s)", parameters.c_str());
+    if (options->stats)
+    {
+        wr_line(body, "#ifdef SHD_STATS");
+        wr_line(body, "stats[0].calls++;");
+        wr_line(body, "#endif");
+    }
+
+    // Calling the setters of the active uniforms
+    active_bit = 0;
+    for (const auto& [_, u] : uniforms)
+    {
+        wr_format_line(body, "if (active[%d] & (1u << %d)) %s(%s_v);", active_bit / 32, active_bit % 32, u.name, u.name);
+        active_bit++;
+    }
+
+    end_method(body);
+
+    if (options->stats)
+    {
+        write_stats_methods(&target, (int)uniforms.size() + 1);
+
+        // Lists the uniforms the linker removed, whose parameters can be removed as well
+        write_stats_guard(&target, "#ifdef SHD_STATS");
+        body = begin_method(&target, "report_inactive()");
+        // Without loose uniforms, there is no `active` mask
+        if (!uniforms.empty())
+        {
+            wr_format_line(body, "for (int i = 0; i < %d; i++)", (int)uniforms.size());
+            wr_start_block(body);
+            wr_line(body, "if (!(active[i / 32] & (1u << (i % 32))))");
+            wr_start_block(body);
+            wr_format_line(body, "printf(\"%s: inactive uniform %%s\\n\", stats[i + 1].name);", struct_name.c_str());
+            wr_end_block(body);
+            wr_end_block(body);
+        }
+        end_method(body);
+        write_stats_guard(&target, "#endif");
+    }
+
+    if (options->record)
+    {
+        write_replay(&target, options, uniforms);
+    }
+
+    if (options->binary_cache)
+    {
+        write_load_or_link(&target, hash_program_sources(declarations, defines));
+    }
+    wr_end_struct(wr);
+
+    if (options->record)
+    {
+        write_recorder(wr, implementation, options, iteration_option->output_struct_name, uniforms);
+    }
+
+    fclose(writer.stream);
+}
+
+// The implementation file is a single unity-build translation unit with the method definitions
+// of all programs and uniform blocks.
+inline void write_implementation_header(Writer* writer, Options* options)
+{
+    wr_puts(writer,
+        "// Warning: This file has been autogenerated by the tool!\n"\
+        "#include <glm/glm.hpp>\n" \
+        "#include <glm/gtc/type_ptr.hpp>\n"
+    );
+    wr_format_line(writer, "#include <%s>", options->gl_header);
+    if (!options->batched_blocks.empty() || options->binary_cache)
+    {
+        wr_line(writer, "#include <stdio.h>");
+        wr_line(writer, "#include <stdlib.h>");
+        wr_line(writer, "#include <string.h>");
+    }
+    if (options->pack_kernels)
+    {
+        write_pack_preamble(writer);
+    }
+    wr_format_line(writer, "#include \"%s\"", options->custom_types_file);
+    wr_format_line(writer, "#include \"%s\"", options->uniform_buffer_file);
+    for (const auto& iteration_option : options->iteration_options)
+    {
+        wr_format_line(writer, "#include \"%s\"", iteration_option.output_file);
+    }
+}
+
+void run(Options* options)
+{
+    Writer implementation_writer;
+    Writer* implementation = 0;
+    if (options->implementation_file != 0)
+    {
+        implementation_writer.stream = fopen(options->implementation_file, "w+");
+        implementation_writer.current_indentation_level = 0;
+        implementation_writer.spaces_per_tab = options->spaces_per_tab;
+        implementation = &implementation_writer;
+        write_implementation_header(implementation, options);
+    }
+
+    parse_vulkan_glsl = options->backend == BACKEND_VULKAN;
+    for (Iteration_Option& iteration_option : options->iteration_options)
+    {
+        run_iteration(options, &iteration_option, implementation);
+    }
+
+    for (const auto& type : options->batched_blocks)
+    {
+        if (uniform_blocks.find(type) == uniform_blocks.end())
+        {
+            fprintf(stderr, "shd Error: Cannot batch \"%s\", no uniform block with that name was found.\n", type.c_str());
+            exit(-1);
+        }
+    }
+    Writer writer;
+    writer.current_indentation_level = 0;
+    writer.spaces_per_tab = options->spaces_per_tab;
+
+    writer.stream = fopen(options->uniform_buffer_file, "w+");
+    if (options->backend == BACKEND_VULKAN)
+    {
+        write_vulkan_header(&writer);
+    }
+    else if (implementation == 0)
+    {
+        write_header(&writer, options);
+        wr_line(&writer, "#include <glm/gtc/type_ptr.hpp>");
+    }
+    else
+    {
+        write_lean_header(&writer, options);
+        wr_line(&writer, "#include <glm/glm.hpp>");
+    }
+    if (!options->batched_blocks.empty() && implementation == 0)
+    {
+        wr_line(&writer, "#include <stdlib.h>");
+        wr_line(&writer, "#include <string.h>");
+    }
+    if (options->pack_kernels && implementation == 0)
+    {
+        write_pack_preamble(&writer);
+    }
+    else if (options->pack_kernels)
+    {
+        // For size_t and for the offsetof of the static_asserts, the kernels themselves go into the implementation
+        wr_line(&writer, "#include <stddef.h>");
+    }
+    if (options->stats)
+    {
+        write_stats_preamble(&writer);
+    }
+    write_uniform_buffer_declarations(&writer, implementation, options);
+    fclose(writer.stream);
+
+    writer.stream = fopen(options->custom_types_file, "w+");
+    if (options->backend == BACKEND_VULKAN)
+    {
+        write_vulkan_header(&writer);
+    }
+    else if (implementation == 0)
+    {
+        write_header(&writer, options);
+    }
+    else
+    {
+        // The structs have glm members, so they need the full definitions, but no GL.
+        write_lean_header(&writer, options);
+        wr_line(&writer, "#include <glm/glm.hpp>");
+    }
+    write_custom_type_declarations(&writer, options);
+    fclose(writer.stream);
+
+    if (implementation != 0)
+    {
+        fclose(implementation->stream);
+    }
+}
+
+Iteration_Option make_iteration_option(const char* output_file, std::vector<const char*>&& input_files)
+{
+    Iteration_Option option;
+    option.input_files = std::move(input_files);
+    option.output_file = output_file;
+
+    auto output_struct_name = sb_create(64);
+    const char* last_slash = strrchr(output_file, '/'); 
+    const char* last_back_slash = strrchr(output_file, '\\');
+    const char* actual_file_name = max({ last_slash + 1, last_back_slash + 1, output_file });
+
+    sb_cat_until(output_struct_name, actual_file_name, '.');
+    if (output_struct_name.data[0] >= 'a' && output_struct_name.data[0] <= 'z')
+    {
+        output_struct_name.data[0] += 'A' - 'a';
+    }
+
+    option.output_struct_name = sb_build(output_struct_name);
+    return option;
+}
+
+Backend parse_backend(const char* name)
 {
-    int spaces_per_tab;
-    const char* uniform_buffer_file;
-    const char* custom_types_file;
-    std::vector<Iteration_Option> iteration_options;
-};
+    for (int i = 0; i < BACKEND_COUNT; i++)
+    {
+        if (strcmp(name, backend_names[i]) == 0)
+        {
+            return (Backend)i;
+        }
+    }
+    fprintf(stderr, "shd Error: Unknown backend \"%s\". Expected \"gl\", \"dsa\" or \"vulkan\".\n", name);
+    exit(-1);
+}
 
-void run_iteration(Options* options, Iteration_Option* iteration_option)
+// Whether the definition is `NAME` or `NAME=VALUE`, where the value has no whitespace.
+inline bool is_valid_define(const char* definition)
 {
-    std::map<std::string, Uniform> uniforms;
+    const char* at = definition;
+    if (!pp_is_identifier_start(*at))
+    {
+        return false;
+    }
+    while (pp_is_identifier_char(*at))
+    {
+        at++;
+    }
+    if (*at == '=')
+    {
+        at++;
+        while (*at != '\0' && !scan_is_whitespace(*at))
+        {
+            at++;
+        }
+    }
+    return *at == '\0';
+}
 
-    for (auto input_file : iteration_option->input_files)
+// The manifest is a line based file, which lets a single process handle any number of programs.
+// Empty lines and lines starting with # are ignored. Every other line is a keyword and a value:
+//
+//   types types.h          the custom types output file (required)
+//   buffers buffers.h      the uniform buffer output file (required)
+//   implementation shd.cpp emit method definitions into this file instead of the headers
+//   backend dsa            gl (default), dsa or vulkan, see `Backend`
+//   pack on                generate repack kernels for uniform blocks, see `write_pack_kernel`
+//   batch Block            generate a per-draw batch for the uniform block, see `write_batch_declaration`
+//   bindless on            set samplers and images as ARB_bindless_texture handles, see `write_opaque`
+//   stats on               instrument the setters behind SHD_STATS, see `write_stats_preamble`
+//   binary_cache on        generate load_or_link() for caching program binaries, see `write_load_or_link`
+//   record on              generate recorders for setting uniforms on other threads, see `write_record_preamble`
+//   gl_header GL/glew.h    the GL header to include instead of glad/gl.h
+//   include shaders/common an include search path
+//   define NAME[=VALUE]    a macro for every program, or for the current program after `output`
+//   output example.h       starts a new program group
+//   input example.vs       adds an input file to the current program group
+void load_manifest(Options* options, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == 0)
+    {
+        fprintf(stderr, "shd Error: Could not open the manifest %s.\n", path);
+        exit(-1);
+    }
+
+    Iteration_Option* current = 0;
+    char buffer[1024];
+    int line = 0;
+    while (fgets(buffer, 1024, file) != NULL)
     {
-        Parse_Info parse_info { input_file, 0 };
-        auto file = fopen(parse_info.file, "r");
-        char buffer[1024];
-        while (fgets(buffer, 1024, file) != NULL)
+        line++;
+        char* keyword = trim_front(trim_front(buffer), '\t');
+        // A # at the start or after whitespace starts a comment
+        for (char* at = keyword; *at != '\0'; at++)
+        {
+            if (*at == '#' && (at == keyword || scan_is_whitespace(at[-1])))
+            {
+                *at = '\0';
+                break;
+            }
+        }
+        char* end = keyword + strlen(keyword);
+        while (end > keyword && scan_is_whitespace(end[-1]))
+        {
+            end--;
+        }
+        *end = '\0';
+        if (*keyword == '\0')
         {
-            parse_info.line++;
+            continue;
+        }
 
-            // line starts with "uniform"
-            if (strstr(buffer, "uniform") == buffer)
+        char* value = keyword;
+        while (*value != '\0' && !scan_is_whitespace(*value))
+        {
+            value++;
+        }
+        if (*value != '\0')
+        {
+            *value = '\0';
+            value++;
+            while (scan_is_whitespace(*value))
             {
-                auto uniform = parse_as_declaration(buffer + sizeof("uniform"), parse_info);
-                uniforms[{ uniform.name }] = uniform;
+                value++;
             }
-            // line starts with "struct" custom struct definition
-            else if (strstr(buffer, "struct") == buffer)
+        }
+        if (*value == '\0')
+        {
+            fprintf(stderr, "shd Error: Expected a value after \"%s\" in file %s, line %d.\n", keyword, path, line);
+            exit(-1);
+        }
+        value = (char*)string_copy_with_malloc(value);
+
+        if (strcmp(keyword, "types") == 0)
+        {
+            options->custom_types_file = value;
+        }
+        else if (strcmp(keyword, "buffers") == 0)
+        {
+            options->uniform_buffer_file = value;
+        }
+        else if (strcmp(keyword, "implementation") == 0)
+        {
+            options->implementation_file = value;
+        }
+        else if (strcmp(keyword, "backend") == 0)
+        {
+            options->backend = parse_backend(value);
+        }
+        else if (strcmp(keyword, "pack") == 0)
+        {
+            options->pack_kernels = strcmp(value, "on") == 0;
+        }
+        else if (strcmp(keyword, "batch") == 0)
+        {
+            options->batched_blocks.insert(value);
+        }
+        else if (strcmp(keyword, "bindless") == 0)
+        {
+            options->bindless_textures = strcmp(value, "on") == 0;
+        }
+        else if (strcmp(keyword, "stats") == 0)
+        {
+            options->stats = strcmp(value, "on") == 0;
+        }
+        else if (strcmp(keyword, "binary_cache") == 0)
+        {
+            options->binary_cache = strcmp(value, "on") == 0;
+        }
+        else if (strcmp(keyword, "record") == 0)
+        {
+            options->record = strcmp(value, "on") == 0;
+        }
+        else if (strcmp(keyword, "gl_header") == 0)
+        {
+            options->gl_header = value;
+        }
+        else if (strcmp(keyword, "include") == 0)
+        {
+            options->include_paths.push_back(value);
+        }
+        else if (strcmp(keyword, "define") == 0)
+        {
+            if (!is_valid_define(value))
             {
-                auto _struct = parse_as_struct(buffer, file, buffer + sizeof("struct"), parse_info);
-                // TODO: Check if the members are the same. 
-                // If not, notify the user that different structs with same name are not allowed.
-                custom_types[{ _struct.name }] = std::move(_struct.members);
+                fprintf(stderr, "shd Error: Malformed define \"%s\" in file %s, line %d. Expected NAME or NAME=VALUE.\n", 
+                    value, path, line);
+                exit(-1);
             }
-            // Uniform block layout
-            else if (strstr(buffer, "layout (std140) uniform") == buffer)
+            pp_define_from_command_line(current ? current->defines : options->defines, value);
+        }
+        else if (strcmp(keyword, "output") == 0)
+        {
+            options->iteration_options.push_back(make_iteration_option(value, {}));
+            current = &options->iteration_options.back();
+        }
+        else if (strcmp(keyword, "input") == 0)
+        {
+            if (current == 0)
             {
-                // 1. Process exactly as a struct
-                auto _struct = parse_as_struct(buffer, file, buffer + sizeof("layout (std140) uniform"), parse_info);
-                // 2. Do NOT add that data into uniform generation.
-                //    Instead, write all unique block descriptors into a separate struct, since they may be shared
-                //    between multiple shaders. That struct will have methods (or functions, I am not sure yet) for
-                //    creating and binding the buffer and for setting a value for the uniform block.
-                // 3. Uniform block layouts follow this spec for data layout: 
-                //    https://www.khronos.org/registry/OpenGL/extensions/ARB/ARB_uniform_buffer_object.txt
-                //    maybe use a tool for figuring out the offsets, but the algorithm shouldn't be hard.
-                uniform_blocks[{ _struct.name }] = Uniform_Block{};
-                Uniform_Block* block = &uniform_blocks[{ _struct.name }];
-
-                uint32_t current_offset = 0;
-                for (const auto& member : _struct.members)
-                {
-                    const auto& member_type_info = uniform_type_map[{ member.type }];
-                    auto member_size = member_type_info.size_in_bytes;
-                    auto member_alignment = member_type_info.base_alignment;
-                    auto current_alignment = current_offset % member_alignment;
-
-                    // if the member is not properly aligned, do so
-                    // E.g. the alignment of a float is N, so it will always fit
-                    // The alignment of a vec2 is 2N, which means that if a vec2 follows a float,
-                    // the float would be in the first 4 bytes, the next 4 bytes will be skipped 
-                    // and then would go the vec2.
-                    if (current_alignment != 0)
-                    {
-                        auto skipped_bytes = member_alignment - current_alignment;
-                        block->pad_bytes.push_back(skipped_bytes);
-                        current_offset += skipped_bytes;
-                    }
-                    else
-                    {
-                        block->pad_bytes.push_back(0);
-                    }
-                    
-                    block->offsets.push_back(current_offset);
-                    current_offset += member_size;
-                }
-
-                block->total_size = current_offset;
-                block->members = std::move(_struct.members);
+                fprintf(stderr, "shd Error: \"input\" before any \"output\" in file %s, line %d.\n", path, line);
+                exit(-1);
             }
-            
+            current->input_files.push_back(value);
+        }
+        else
+        {
+            fprintf(stderr, "shd Error: Unknown manifest keyword \"%s\" in file %s, line %d.\n", keyword, path, line);
+            exit(-1);
         }
-        fclose(file);
     }
+    fclose(file);
 
-    Writer writer;
-    writer.stream = fopen(iteration_option->output_file, "w+");
-    writer.current_indentation_level = 0;
-    writer.spaces_per_tab = options->spaces_per_tab;
-    Writer *wr = &writer;
-    
-    write_header(wr);
-    wr_format_line(wr, "#include \"%s\"", options->custom_types_file);
-    wr_format_line(wr, "#include \"%s\"", options->uniform_buffer_file);
-
-    wr_format_line(wr, "struct %s_Program", iteration_option->output_struct_name);
-    wr_start_struct(wr);
-    wr_line(wr, "GLuint id;");
-    wr_line(wr, "inline void use()");
-    wr_start_block(wr);
-    wr_line(wr, "glUseProgram(id);");
-    wr_end_block(wr);
-        
-    // Location declarations
-    for (const auto& [_, u] : uniforms)
+    if (options->custom_types_file == 0 || options->uniform_buffer_file == 0)
     {
-        write_location_declaration(wr, u);
+        fprintf(stderr, "shd Error: The manifest %s must specify both \"types\" and \"buffers\".\n", path);
+        exit(-1);
     }
-
-    // Uniform blocks indices
-    for (auto const& [type, _] : uniform_blocks)
+    for (const auto& option : options->iteration_options)
     {
-        wr_format_line(wr, "GLint %s_block_index;", type.c_str());  
+        if (option.input_files.empty())
+        {
+            fprintf(stderr, "shd Error: The output %s has no input files in the manifest %s.\n", option.output_file, path);
+            exit(-1);
+        }
     }
+}
 
-    // Uniform setters
-    for (const auto& [_, u] : uniforms)
+void validate_options(Options* options)
+{
+    if (options->backend == BACKEND_VULKAN && options->implementation_file != 0)
     {
-        wr_format_line(wr, "inline void %s(%s %s)", u.name, u.type, u.name);
-        wr_start_block(wr);
-        write_uniform(wr, u);
-        wr_end_block(wr);
+        fputs("shd Error: The vulkan backend emits no methods, so it cannot be combined with an implementation file.\n", stderr);
+        exit(-1);
     }
-
-    // Uniform block setters.
-    for (auto const& [type, _] : uniform_blocks)
+    if (options->backend == BACKEND_VULKAN && options->binary_cache)
     {
-        wr_format_line(wr, "inline void %s_block(%s_Block %s_block)", type.c_str(), type.c_str(), type.c_str());
-        wr_start_block(wr);
-        wr_format_line(wr, "glUniformBlockBinding(id, %s_block_index, %s_block.binding_point);", type.c_str(), type.c_str());
-        wr_end_block(wr);
+        fputs("shd Error: The vulkan backend has no GL programs to cache, use a VkPipelineCache instead.\n", stderr);
+        exit(-1);
     }
-
-    // Initializing locations
-    wr_line(wr, "inline void query_locations()");
-    wr_start_block(wr);
-
-    for (const auto& [_, u] : uniforms)
+    if (options->backend == BACKEND_VULKAN && options->record)
     {
-        write_location(wr, u);
+        fputs("shd Error: The vulkan backend emits no setters, so there is nothing to record.\n", stderr);
+        exit(-1);
     }
-
-    // Getting the indices for uniform blocks.
-    for (const auto & [type, _] : uniform_blocks)
+    if (options->backend == BACKEND_VULKAN && options->stats)
     {
-        wr_format_line(wr, "%s_block_index = glGetUniformBlockIndex(id, \"%s\");", type.c_str(), type.c_str());
+        fputs("shd Error: The vulkan backend emits no setters, so there is nothing to instrument.\n", stderr);
+        exit(-1);
+    }
+    if (options->backend == BACKEND_VULKAN && !options->batched_blocks.empty())
+    {
+        fputs("shd Error: Batches are GL uniform buffers, so they cannot be combined with the vulkan backend.\n", stderr);
+        exit(-1);
     }
-    
-    wr_end_block(wr);
-
-    // Setting all uniforms. The function header.
-    wr_print_indent(wr);
-    wr_puts(wr, "inline void uniforms(");
 
+    std::map<std::string, int> outputs;
+    outputs[options->custom_types_file]++;
+    outputs[options->uniform_buffer_file]++;
+    if (options->implementation_file != 0)
     {
-        int i = 0;
-        int num_uniforms = uniforms.size();
-        for (const auto& [_, u] : uniforms)
+        outputs[options->implementation_file]++;
+    }
+    // The rewritten copies of inputs with @frequency annotations are checked as they are written, see
+    // `check_frequency_source`
+    for (const auto& option : options->iteration_options)
+    {
+        outputs[option.output_file]++;
+    }
+    for (const auto& [output, count] : outputs)
+    {
+        if (count > 1)
         {
-            wr_format(wr, "%s %s_v", u.type, u.name);
-            i++;
-            if (i < num_uniforms)
-            {
-                wr_puts(wr, ", ");
-            }
+            fprintf(stderr, "shd Error: The output file %s is specified more than once.\n", output.c_str());
+            exit(-1);
         }
     }
-
-    wr_puts(wr, ")\n");
-    wr_start_block(wr);
-
-    // Calling the appropriate uniform setters.
-    for (const auto& [_, u] : uniforms)
+    for (const auto& option : options->iteration_options)
     {
-        wr_format_line(wr, "%s(%s_v);", u.name, u.name);
+        for (auto input_file : option.input_files)
+        {
+            if (outputs.find(input_file) != outputs.end())
+            {
+                fprintf(stderr, "shd Error: The input file %s would be overwritten by an output.\n", input_file);
+                exit(-1);
+            }
+        }
     }
-
-    wr_end_block(wr);
-    wr_end_struct(wr);
-
-    fclose(writer.stream);
 }
 
-void run(Options* options)
+inline bool is_preprocessor_flag(const char* arg)
 {
-    for (Iteration_Option& iteration_option : options->iteration_options)
-    {
-        run_iteration(options, &iteration_option);
-    }
-    Writer writer;
-    writer.current_indentation_level = 0;
-    writer.spaces_per_tab = options->spaces_per_tab;
-
-    writer.stream = fopen(options->uniform_buffer_file, "w+");
-    write_header(&writer);
-    wr_line(&writer, "#include <glm/gtc/type_ptr.hpp>");
-    write_uniform_buffer_declarations(&writer);
+    return strncmp(arg, "-D", 2) == 0 || strncmp(arg, "-I", 2) == 0;
+}
 
-    writer.stream = fopen(options->custom_types_file, "w+");
-    write_header(&writer);
-    write_custom_type_declarations(&writer);
+// Whether the argument ends the list of input files of an --output group
+inline bool is_option(const char* arg)
+{
+    return strcmp(arg, "--output") == 0 || strcmp(arg, "--implementation") == 0
+        || strcmp(arg, "--backend") == 0 || strcmp(arg, "--pack") == 0 
+        || strcmp(arg, "--batch") == 0 || strcmp(arg, "--bindless") == 0 
+        || strcmp(arg, "--stats") == 0 || strcmp(arg, "--gl-header") == 0 
+        || strcmp(arg, "--record") == 0 || strcmp(arg, "--binary-cache") == 0 || is_preprocessor_flag(arg);
 }
 
 int main(int argc, char** argv)
 {
+    Options options;
+    options.spaces_per_tab = 4;
+    options.custom_types_file = 0;
+    options.uniform_buffer_file = 0;
+    options.implementation_file = 0;
+    options.backend = BACKEND_GL;
+    options.pack_kernels = false;
+    options.bindless_textures = false;
+    options.stats = false;
+    options.gl_header = "glad/gl.h";
+    options.record = false;
+    options.binary_cache = false;
+
+    if (argc == 3 && strcmp(argv[1], "--manifest") == 0)
+    {
+        load_manifest(&options, argv[2]);
+        validate_options(&options);
+        run(&options);
+        return 0;
+    }
+
     if (argc < 4)
     {
         // -spaces_per_tab=4
         // -types_output=required/null
         // -uniform_buffer_output=required/null
         // --output OUTPUT INPUT [INPUT ...]
-        fputs("No output-input group provided. Usage: shd <custom_types_output_file> <uniform_buffer_output_file> --output <output_file> <input_file> [input_file ...]", stderr);
+        // -D NAME[=VALUE], -I PATH
+        // --implementation CPP
+        // --backend gl|dsa|vulkan
+        // --pack
+        // --batch BLOCK
+        // --bindless
+        // --stats
+        // --gl-header HEADER
+        // --record
+        // --binary-cache
+        // --manifest MANIFEST
+        fputs("No output-input group provided. Usage: shd <custom_types_output_file> <uniform_buffer_output_file> [-D NAME[=VALUE]] [-I include_path] [--implementation <cpp_file>] [--backend gl|dsa|vulkan] [--pack] [--batch <block>] [--bindless] [--stats] [--gl-header <header>] [--record] [--binary-cache] --output <output_file> <input_file> [input_file ...]\n"
+            "   or: shd --manifest <manifest_file>", stderr);
         exit(-1);
     }
 
-    Options options;
-
     for (int i = 3; i < argc; i++)
     {
         const char* output_file;
         std::vector<const char*> input_files;
 
+        // Defines and include paths apply to all output groups.
+        if (is_preprocessor_flag(argv[i]))
+        {
+            char flag = argv[i][1];
+            const char* value = argv[i] + 2;
+            if (*value == '\0')
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "No value provided after -%c", flag);
+                    exit(-1);
+                }
+                value = argv[i];
+            }
+            if (flag == 'D')
+            {
+                if (!is_valid_define(value))
+                {
+                    fprintf(stderr, "shd Error: Malformed define \"%s\". Expected -D NAME or -D NAME=VALUE.\n", value);
+                    exit(-1);
+                }
+                pp_define_from_command_line(options.defines, value);
+            }
+            else
+            {
+                options.include_paths.push_back(value);
+            }
+            continue;
+        }
+
+        if (strcmp(argv[i], "--implementation") == 0)
+        {
+            if (++i >= argc)
+            {
+                fputs("No output file provided after --implementation", stderr);
+                exit(-1);
+            }
+            options.implementation_file = argv[i];
+            continue;
+        }
+
+        if (strcmp(argv[i], "--backend") == 0)
+        {
+            if (++i >= argc)
+            {
+                fputs("No backend provided after --backend", stderr);
+                exit(-1);
+            }
+            options.backend = parse_backend(argv[i]);
+            continue;
+        }
+
+        if (strcmp(argv[i], "--pack") == 0)
+        {
+            options.pack_kernels = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--binary-cache") == 0)
+        {
+            options.binary_cache = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--record") == 0)
+        {
+            options.record = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--gl-header") == 0)
+        {
+            if (++i >= argc)
+            {
+                fputs("No header provided after --gl-header", stderr);
+                exit(-1);
+            }
+            options.gl_header = argv[i];
+            continue;
+        }
+
+        if (strcmp(argv[i], "--stats") == 0)
+        {
+            options.stats = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--bindless") == 0)
+        {
+            options.bindless_textures = true;
+            continue;
+        }
+
+        if (strcmp(argv[i], "--batch") == 0)
+        {
+            if (++i >= argc)
+            {
+                fputs("No uniform block name provided after --batch", stderr);
+                exit(-1);
+            }
+            options.batched_blocks.insert(argv[i]);
+            continue;
+        }
+
         if (strcmp(argv[i], "--output") == 0)
         {
             if (++i >= argc)
@@ -598,7 +3215,7 @@ int main(int argc, char** argv)
                 exit(-1);
             }
             output_file = argv[i];
-            while (++i < argc && strcmp(argv[i], "--output") != 0)
+            while (++i < argc && !is_option(argv[i]))
             {
                 input_files.push_back(argv[i]);
             }
@@ -632,28 +3249,12 @@ int main(int argc, char** argv)
             exit(-1);
         }
 
-        Iteration_Option option;
-        option.input_files = std::move(input_files);
-        option.output_file = output_file;
-
-        auto output_struct_name = sb_create(64);
-        const char* last_slash = strrchr(output_file, '/'); 
-        const char* last_back_slash = strrchr(output_file, '\\');
-        const char* actual_file_name = max({ last_slash + 1, last_back_slash + 1, output_file });
-
-        sb_cat_until(output_struct_name, actual_file_name, '.');
-        if (output_struct_name.data[0] >= 'a' && output_struct_name.data[0] <= 'z')
-        {
-            output_struct_name.data[0] += 'A' - 'a';
-        }
-
-        option.output_struct_name = sb_build(output_struct_name);
-        options.iteration_options.push_back(option);
+        options.iteration_options.push_back(make_iteration_option(output_file, std::move(input_files)));
     }
 
-    options.spaces_per_tab = 4;
     options.custom_types_file = argv[1];
     options.uniform_buffer_file = argv[2];
 
+    validate_options(&options);
     run(&options);
 }
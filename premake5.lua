@@ -22,3 +22,90 @@ project "shader_descriptor"
         optimize "On"
 
     filter {}
+
+-- Tests are plain executables which print what failed and return non-zero.
+-- Run them from the repository root after building, e.g. bin/Release/scan_test.
+local function test_project(name, sources)
+    project(name)
+        kind "ConsoleApp"
+        language "C++"
+        cppdialect "C++17"
+
+        targetdir "bin/%{cfg.buildcfg}"
+        objdir "bin-int/%{cfg.buildcfg}/%{prj.name}"
+
+        files(sources)
+
+        filter "configurations:Debug"
+            symbols "On"
+
+        filter "configurations:Release"
+            optimize "On"
+
+        filter {}
+end
+
+-- A test or benchmark of generated code. The generator runs with the given arguments before the build, %{cfg.objdir}
+-- standing for the directory of the generated files, and it is linked with the stand-in GL of tests/stub.
+local function generated_code_project(name, sources, arguments)
+    test_project(name, table.join(sources, { "tests/stub/gl_stub.cpp", "tests/stub/**.h", "tests/stub/**.hpp" }))
+        dependson { "shader_descriptor" }
+        includedirs { "tests/stub", "%{cfg.objdir}" }
+        prebuildcommands { "cd %{wks.location}/.. && %{cfg.targetdir}/shader_descriptor " .. arguments }
+end
+
+group "tests"
+    test_project("scan_test", { "tests/scan_test.cpp" })
+
+    -- The same test against the AVX2 version of the scanner
+    test_project("scan_test_avx2", { "tests/scan_test.cpp" })
+        vectorextensions "AVX2"
+
+    test_project("preprocessor_test", { "tests/preprocessor_test.cpp", "src/preprocessor.h" })
+
+    generated_code_project("dsa_test", { "tests/dsa_test.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --backend dsa --output %{cfg.objdir}/example.h example/example.vs example/example.fs")
+
+    generated_code_project("binary_cache_test", { "tests/binary_cache_test.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --binary-cache --output %{cfg.objdir}/example.h example/example.vs example/example.fs")
+
+    generated_code_project("inactive_test", { "tests/inactive_test.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --backend dsa --stats --output %{cfg.objdir}/example.h example/example.vs example/example.fs")
+        defines { "SHD_STATS" }
+
+    generated_code_project("record_test", { "tests/record_test.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --backend dsa --record --output %{cfg.objdir}/example.h example/example.vs example/example.fs")
+        filter "system:linux"
+            links { "pthread" }
+        filter {}
+
+    -- The repack kernels with SSE2, with AVX and scalar
+    generated_code_project("pack_test", { "tests/pack_test.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --pack --output %{cfg.objdir}/pack.h tests/shaders/pack.vs")
+
+    generated_code_project("pack_test_avx", { "tests/pack_test.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --pack --output %{cfg.objdir}/pack.h tests/shaders/pack.vs")
+        vectorextensions "AVX"
+
+    generated_code_project("pack_test_scalar", { "tests/pack_test.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --pack --output %{cfg.objdir}/pack.h tests/shaders/pack.vs")
+        defines { "SHD_PACK_SCALAR" }
+group ""
+
+-- Frame patterns timed against the stand-in GL, once per backend, e.g. bin/Release/frame_bench_gl
+group "bench"
+    generated_code_project("frame_bench_gl", { "bench/frame_bench.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --output %{cfg.objdir}/bench.h bench/shaders/bench.vs bench/shaders/bench.fs")
+        defines { "FRAME_BENCH_GL" }
+
+    generated_code_project("frame_bench_dsa", { "bench/frame_bench.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --backend dsa --output %{cfg.objdir}/bench.h bench/shaders/bench.vs bench/shaders/bench.fs")
+
+    -- The repack kernels against a memcpy per member, e.g. bin/Release/pack_bench
+    generated_code_project("pack_bench", { "bench/pack_bench.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --pack --output %{cfg.objdir}/pack.h bench/shaders/pack.vs")
+
+    generated_code_project("pack_bench_avx", { "bench/pack_bench.cpp" },
+        "%{cfg.objdir}/types.h %{cfg.objdir}/buffers.h --pack --output %{cfg.objdir}/pack.h bench/shaders/pack.vs")
+        vectorextensions "AVX"
+group ""
@@ -0,0 +1,751 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+// A small GLSL preprocessor. It understands #include (GL_GOOGLE_include_directive style),
+// object-like and function-like #define, #undef, #ifdef, #ifndef, #if, #elif, #else, #endif
+// and #pragma once, as well as line continuations and comments. Other directives (#version, #extension, 
+// #line, other pragmas) are skipped.
+// Only object-like macros are expanded in regular lines, which is enough for the declarations we parse.
+
+struct Pp_Macro
+{
+    std::string value;
+    bool function_like;
+};
+
+struct Pp_Conditional
+{
+    bool parent_active; // whether the region the conditional is nested in is active
+    bool taken;         // whether one of the branches has already been taken
+    bool active;        // whether the current branch is active
+    bool seen_else;
+};
+
+// An open file being preprocessed.
+struct Pp_Source
+{
+    FILE* file;
+    const char* path;
+    int line;
+    bool in_comment; // whether a /* */ comment continues from the previous line
+    std::vector<Pp_Conditional> conditionals;
+};
+
+struct Preprocessor
+{
+    std::vector<const char*> include_paths;
+    std::map<std::string, Pp_Macro> defines;
+    // Files which contained #pragma once and have been included already
+    std::set<std::string> once_files;
+};
+
+enum Pp_Line_Kind
+{
+    PP_LINE,
+    PP_INCLUDE,
+    PP_END
+};
+
+inline void pp_error(Pp_Source* source, const char* message, const char* detail = "")
+{
+    fprintf(stderr, "shd Error: %s%s in file %s, line %d.\n", message, detail, source->path, source->line);
+    exit(-1);
+}
+
+inline bool pp_is_identifier_start(char ch)
+{
+    return isalpha((unsigned char)ch) || ch == '_';
+}
+
+inline bool pp_is_identifier_char(char ch)
+{
+    return isalnum((unsigned char)ch) || ch == '_';
+}
+
+inline const char* pp_skip_spaces(const char* at)
+{
+    while (*at == ' ' || *at == '\t')
+    {
+        at++;
+    }
+    return at;
+}
+
+inline std::string pp_read_identifier(const char*& at)
+{
+    const char* start = at;
+    while (pp_is_identifier_char(*at))
+    {
+        at++;
+    }
+    return std::string(start, at - start);
+}
+
+inline bool pp_is_active(Pp_Source* source)
+{
+    return source->conditionals.empty() || source->conditionals.back().active;
+}
+
+// Accepts `NAME`, `NAME=VALUE` as given to -D. A define without a value expands to 1, like in C compilers.
+inline void pp_define_from_command_line(std::map<std::string, Pp_Macro>& defines, const char* definition)
+{
+    const char* equals = strchr(definition, '=');
+    if (equals == 0)
+    {
+        defines[definition] = Pp_Macro{ "1", false };
+    }
+    else
+    {
+        defines[std::string(definition, equals - definition)] = Pp_Macro{ equals + 1, false };
+    }
+}
+
+// Serializes the current macro table, so that it can be used as part of a cache key.
+inline std::string pp_serialize_defines(const std::map<std::string, Pp_Macro>& defines)
+{
+    std::string result;
+    for (const auto& [name, macro] : defines)
+    {
+        result += name;
+        result += macro.function_like ? "()=" : "=";
+        result += macro.value;
+        result += '\n';
+    }
+    return result;
+}
+
+// Expands object-like macros in the given text. Macros currently being expanded are not expanded again,
+// which prevents infinite recursion on self-referential definitions.
+inline std::string pp_expand(Preprocessor* pp, const std::string& text, std::vector<std::string>& expanding)
+{
+    std::string result;
+    const char* at = text.c_str();
+    while (*at != 0)
+    {
+        if (pp_is_identifier_start(*at))
+        {
+            std::string identifier = pp_read_identifier(at);
+            auto macro = pp->defines.find(identifier);
+            bool is_expanding = false;
+            for (const auto& name : expanding)
+            {
+                if (name == identifier)
+                {
+                    is_expanding = true;
+                    break;
+                }
+            }
+            if (macro != pp->defines.end() && !macro->second.function_like && !is_expanding)
+            {
+                expanding.push_back(identifier);
+                result += pp_expand(pp, macro->second.value, expanding);
+                expanding.pop_back();
+            }
+            else
+            {
+                result += identifier;
+            }
+        }
+        else if (isdigit((unsigned char)*at))
+        {
+            // Don't treat suffixes like the `f` in `1.0f` as identifiers
+            while (pp_is_identifier_char(*at) || *at == '.')
+            {
+                result += *at;
+                at++;
+            }
+        }
+        else if (at[0] == '/' && at[1] == '/')
+        {
+            result += at;
+            break;
+        }
+        else
+        {
+            result += *at;
+            at++;
+        }
+    }
+    return result;
+}
+
+
+// #if expression evaluation. Follows the C operator precedence, without the ternary operator.
+
+struct Pp_Expression
+{
+    const char* at;
+    Pp_Source* source;
+};
+
+inline long pp_eval_binary(Pp_Expression* expr, int level);
+
+inline long pp_eval_unary(Pp_Expression* expr)
+{
+    expr->at = pp_skip_spaces(expr->at);
+    char ch = *expr->at;
+
+    if (ch == '(')
+    {
+        expr->at++;
+        long value = pp_eval_binary(expr, 0);
+        expr->at = pp_skip_spaces(expr->at);
+        if (*expr->at != ')')
+        {
+            pp_error(expr->source, "Expected ')' in #if expression");
+        }
+        expr->at++;
+        return value;
+    }
+    if (ch == '!') { expr->at++; return !pp_eval_unary(expr); }
+    if (ch == '~') { expr->at++; return ~pp_eval_unary(expr); }
+    if (ch == '-') { expr->at++; return -pp_eval_unary(expr); }
+    if (ch == '+') { expr->at++; return pp_eval_unary(expr); }
+
+    if (isdigit((unsigned char)ch))
+    {
+        char* end;
+        long value = strtol(expr->at, &end, 0);
+        expr->at = end;
+        while (*expr->at == 'u' || *expr->at == 'U' || *expr->at == 'l' || *expr->at == 'L')
+        {
+            expr->at++;
+        }
+        return value;
+    }
+    // Identifiers that survived macro expansion evaluate to 0
+    if (pp_is_identifier_start(ch))
+    {
+        pp_read_identifier(expr->at);
+        return 0;
+    }
+
+    pp_error(expr->source, "Unexpected token in #if expression: ", expr->at);
+    return 0;
+}
+
+// Operators grouped by precedence, lowest first. Longer operators come before their prefixes.
+static const char* pp_operator_levels[][5] =
+{
+    { "||" },
+    { "&&" },
+    { "|" },
+    { "^" },
+    { "&" },
+    { "==", "!=" },
+    { "<=", ">=", "<", ">" },
+    { "<<", ">>" },
+    { "+", "-" },
+    { "*", "/", "%" },
+};
+static const int pp_operator_level_count = sizeof(pp_operator_levels) / sizeof(pp_operator_levels[0]);
+
+inline const char* pp_match_operator(Pp_Expression* expr, int level)
+{
+    for (const char* op : pp_operator_levels[level])
+    {
+        if (op == 0)
+        {
+            break;
+        }
+        size_t length = strlen(op);
+        if (strncmp(expr->at, op, length) != 0)
+        {
+            continue;
+        }
+        // `|` must not match the start of `||`, `<` must not match the start of `<<`, etc.
+        if (length == 1 && (expr->at[1] == op[0] || (expr->at[1] == '=' && (op[0] == '<' || op[0] == '>'))))
+        {
+            continue;
+        }
+        expr->at += length;
+        return op;
+    }
+    return 0;
+}
+
+inline long pp_apply_operator(Pp_Expression* expr, const char* op, long left, long right)
+{
+    switch (op[0])
+    {
+        case '|': return op[1] == '|' ? (left || right) : (left | right);
+        case '&': return op[1] == '&' ? (left && right) : (left & right);
+        case '^': return left ^ right;
+        case '=': return left == right;
+        case '!': return left != right;
+        case '<':
+            if (op[1] == '=') return left <= right;
+            if (op[1] == '<') return left << right;
+            return left < right;
+        case '>':
+            if (op[1] == '=') return left >= right;
+            if (op[1] == '>') return left >> right;
+            return left > right;
+        case '+': return left + right;
+        case '-': return left - right;
+        case '*': return left * right;
+        case '/':
+        case '%':
+            if (right == 0)
+            {
+                pp_error(expr->source, "Division by zero in #if expression");
+            }
+            return op[0] == '/' ? left / right : left % right;
+    }
+    return 0;
+}
+
+inline long pp_eval_binary(Pp_Expression* expr, int level)
+{
+    if (level == pp_operator_level_count)
+    {
+        return pp_eval_unary(expr);
+    }
+
+    long left = pp_eval_binary(expr, level + 1);
+    while (true)
+    {
+        expr->at = pp_skip_spaces(expr->at);
+        const char* op = pp_match_operator(expr, level);
+        if (op == 0)
+        {
+            return left;
+        }
+        long right = pp_eval_binary(expr, level + 1);
+        left = pp_apply_operator(expr, op, left, right);
+    }
+}
+
+// Replaces `defined X` and `defined(X)` with 0 or 1, expands macros and evaluates the result.
+inline bool pp_evaluate_condition(Preprocessor* pp, Pp_Source* source, const char* text)
+{
+    std::string replaced;
+    const char* at = text;
+    while (*at != 0)
+    {
+        if (pp_is_identifier_start(*at))
+        {
+            std::string identifier = pp_read_identifier(at);
+            if (identifier != "defined")
+            {
+                replaced += identifier;
+                continue;
+            }
+            at = pp_skip_spaces(at);
+            bool parenthesized = *at == '(';
+            if (parenthesized)
+            {
+                at = pp_skip_spaces(at + 1);
+            }
+            std::string name = pp_read_identifier(at);
+            if (name.empty())
+            {
+                pp_error(source, "Expected a macro name after 'defined'");
+            }
+            if (parenthesized)
+            {
+                at = pp_skip_spaces(at);
+                if (*at != ')')
+                {
+                    pp_error(source, "Expected ')' after 'defined(", name.c_str());
+                }
+                at++;
+            }
+            replaced += pp->defines.find(name) != pp->defines.end() ? " 1 " : " 0 ";
+        }
+        else if (at[0] == '/' && at[1] == '/')
+        {
+            break;
+        }
+        else
+        {
+            replaced += *at;
+            at++;
+        }
+    }
+
+    std::vector<std::string> expanding;
+    std::string expanded = pp_expand(pp, replaced, expanding);
+
+    Pp_Expression expr { expanded.c_str(), source };
+    long value = pp_eval_binary(&expr, 0);
+    expr.at = pp_skip_spaces(expr.at);
+    if (*expr.at != 0 && *expr.at != '\n' && *expr.at != '\r')
+    {
+        pp_error(source, "Unexpected trailing characters in #if expression: ", expr.at);
+    }
+    return value != 0;
+}
+
+inline bool pp_file_exists(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == 0)
+    {
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+// Quoted includes are looked up relative to the including file first, then in the include paths.
+// Angled includes are only looked up in the include paths.
+inline std::string pp_resolve_include(Preprocessor* pp, Pp_Source* source, const std::string& name, bool quoted)
+{
+    if (quoted)
+    {
+        const char* last_slash = strrchr(source->path, '/');
+        const char* last_back_slash = strrchr(source->path, '\\');
+        const char* separator = last_slash > last_back_slash ? last_slash : last_back_slash;
+
+        std::string candidate = separator == 0
+            ? name
+            : std::string(source->path, separator - source->path + 1) + name;
+        if (pp_file_exists(candidate))
+        {
+            return candidate;
+        }
+    }
+    for (const char* include_path : pp->include_paths)
+    {
+        std::string candidate = include_path;
+        if (!candidate.empty() && candidate.back() != '/' && candidate.back() != '\\')
+        {
+            candidate += '/';
+        }
+        candidate += name;
+        if (pp_file_exists(candidate))
+        {
+            return candidate;
+        }
+    }
+    pp_error(source, "Could not find the included file: ", name.c_str());
+    return {};
+}
+
+inline void pp_parse_define(Preprocessor* pp, Pp_Source* source, const char* at)
+{
+    at = pp_skip_spaces(at);
+    std::string name = pp_read_identifier(at);
+    if (name.empty())
+    {
+        pp_error(source, "Expected a macro name after #define");
+    }
+
+    Pp_Macro macro;
+    macro.function_like = *at == '(';
+    if (macro.function_like)
+    {
+        at = strchr(at, ')');
+        if (at == 0)
+        {
+            pp_error(source, "Unterminated parameter list in #define ", name.c_str());
+        }
+        at++;
+    }
+    at = pp_skip_spaces(at);
+
+    const char* end = at + strlen(at);
+    const char* comment = strstr(at, "//");
+    if (comment != 0)
+    {
+        end = comment;
+    }
+    while (end > at && isspace((unsigned char)end[-1]))
+    {
+        end--;
+    }
+    macro.value = std::string(at, end - at);
+    pp->defines[name] = std::move(macro);
+}
+
+// Handles a directive line. Returns PP_INCLUDE and sets `include_path` for an active #include.
+inline Pp_Line_Kind pp_handle_directive(Preprocessor* pp, Pp_Source* source, const char* at, std::string* include_path)
+{
+    at = pp_skip_spaces(at + 1);
+    std::string directive = pp_read_identifier(at);
+    bool active = pp_is_active(source);
+
+    // Conditionals have to be tracked even in inactive regions, to keep the nesting right.
+    if (directive == "ifdef" || directive == "ifndef" || directive == "if")
+    {
+        Pp_Conditional conditional;
+        conditional.parent_active = active;
+        conditional.seen_else = false;
+        conditional.active = false;
+        if (active)
+        {
+            if (directive == "if")
+            {
+                conditional.active = pp_evaluate_condition(pp, source, at);
+            }
+            else
+            {
+                at = pp_skip_spaces(at);
+                bool defined = pp->defines.find(pp_read_identifier(at)) != pp->defines.end();
+                conditional.active = directive == "ifdef" ? defined : !defined;
+            }
+        }
+        conditional.taken = conditional.active;
+        source->conditionals.push_back(conditional);
+        return PP_LINE;
+    }
+    if (directive == "elif" || directive == "else" || directive == "endif")
+    {
+        if (source->conditionals.empty())
+        {
+            pp_error(source, "Unmatched #", directive.c_str());
+        }
+        Pp_Conditional& conditional = source->conditionals.back();
+        if (directive == "endif")
+        {
+            source->conditionals.pop_back();
+            return PP_LINE;
+        }
+        if (conditional.seen_else)
+        {
+            pp_error(source, "Unexpected #", directive.c_str());
+        }
+        if (directive == "else")
+        {
+            conditional.seen_else = true;
+            conditional.active = conditional.parent_active && !conditional.taken;
+        }
+        else
+        {
+            conditional.active = conditional.parent_active && !conditional.taken
+                && pp_evaluate_condition(pp, source, at);
+        }
+        conditional.taken = conditional.taken || conditional.active;
+        return PP_LINE;
+    }
+
+    if (!active)
+    {
+        return PP_LINE;
+    }
+
+    if (directive == "define")
+    {
+        pp_parse_define(pp, source, at);
+    }
+    else if (directive == "undef")
+    {
+        at = pp_skip_spaces(at);
+        pp->defines.erase(pp_read_identifier(at));
+    }
+    else if (directive == "include")
+    {
+        at = pp_skip_spaces(at);
+        char close = *at == '"' ? '"' : (*at == '<' ? '>' : 0);
+        const char* name_end = close ? strchr(at + 1, close) : 0;
+        if (name_end == 0)
+        {
+            pp_error(source, "Expected \"file\" or <file> after #include");
+        }
+        std::string name(at + 1, name_end - at - 1);
+        *include_path = pp_resolve_include(pp, source, name, close == '"');
+        return PP_INCLUDE;
+    }
+    else if (directive == "pragma")
+    {
+        at = pp_skip_spaces(at);
+        if (pp_read_identifier(at) == "once")
+        {
+            pp->once_files.insert(source->path);
+        }
+    }
+    else if (directive == "error")
+    {
+        pp_error(source, "#error", at);
+    }
+    // #version, #extension, #line and the null directive are of no interest to us.
+
+    return PP_LINE;
+}
+
+inline Pp_Source pp_open(const char* path)
+{
+    Pp_Source source;
+    source.path = path;
+    source.line = 0;
+    source.in_comment = false;
+    source.file = fopen(path, "r");
+    if (source.file == 0)
+    {
+        fprintf(stderr, "shd Error: Could not open file %s.\n", path);
+        exit(-1);
+    }
+    return source;
+}
+
+inline void pp_close(Pp_Source* source)
+{
+    fclose(source->file);
+}
+
+// Reads a physical line of any length, including the newline. Returns false at the end of the file.
+inline bool pp_read_physical_line(Pp_Source* source, std::string& line)
+{
+    char chunk[1024];
+    line.clear();
+    while (fgets(chunk, sizeof(chunk), source->file) != NULL)
+    {
+        line += chunk;
+        if (line.back() == '\n')
+        {
+            break;
+        }
+    }
+    if (line.empty())
+    {
+        return false;
+    }
+    source->line++;
+    return true;
+}
+
+// Reads a logical line: physical lines ending with a backslash are joined with the next one, and /* */ comments
+// are replaced with a space, also when they span multiple lines. Line comments are kept, except in directives.
+inline bool pp_read_line(Pp_Source* source, std::string& line)
+{
+    std::string physical;
+    line.clear();
+    while (pp_read_physical_line(source, physical))
+    {
+        for (size_t i = 0; i < physical.size(); i++)
+        {
+            if (source->in_comment)
+            {
+                if (physical.compare(i, 2, "*/") == 0)
+                {
+                    source->in_comment = false;
+                    line += ' ';
+                    i++;
+                }
+                continue;
+            }
+            if (physical.compare(i, 2, "//") == 0)
+            {
+                line.append(physical, i, std::string::npos);
+                break;
+            }
+            if (physical.compare(i, 2, "/*") == 0)
+            {
+                source->in_comment = true;
+                i++;
+                continue;
+            }
+            line += physical[i];
+        }
+        if (line.size() >= 2 && line.compare(line.size() - 2, 2, "\\\n") == 0)
+        {
+            line.resize(line.size() - 2);
+            continue;
+        }
+        if (!line.empty() && line.back() != '\n')
+        {
+            line += '\n';
+        }
+        return true;
+    }
+    return !line.empty();
+}
+
+// Reads lines until the next active non-directive line, which is written into `line` with macros expanded.
+// Returns PP_INCLUDE when an active #include is encountered, in which case the resolved path is written
+// into `include_path` and the caller is responsible for processing that file.
+inline Pp_Line_Kind pp_next_line(Preprocessor* pp, Pp_Source* source, std::string* line, std::string* include_path)
+{
+    while (pp_read_line(source, *line))
+    {
+        const char* at = pp_skip_spaces(line->c_str());
+
+        if (*at == '#')
+        {
+            if (pp_handle_directive(pp, source, at, include_path) == PP_INCLUDE)
+            {
+                return PP_INCLUDE;
+            }
+            continue;
+        }
+        if (!pp_is_active(source))
+        {
+            continue;
+        }
+        if (!pp->defines.empty())
+        {
+            std::vector<std::string> expanding;
+            *line = pp_expand(pp, *line, expanding);
+        }
+        return PP_LINE;
+    }
+
+    if (!source->conditionals.empty())
+    {
+        pp_error(source, "Unterminated conditional directive at the end of the file");
+    }
+    return PP_END;
+}
+
+// The result of processing a file, and the state of the preprocessor after it.
+template <typename T>
+struct Pp_Cached_File
+{
+    T result;
+    std::map<std::string, Pp_Macro> defines_after; // the macros defined after processing the file
+    std::set<std::string> once_files_after; // the #pragma once files included after processing the file
+};
+
+// Files are keyed by their path, the macros defined and the #pragma once files included at the point 
+// of inclusion, so that a file shared between many inputs and output groups is only processed once per run.
+template <typename T>
+struct Pp_File_Cache
+{
+    std::map<std::string, Pp_Cached_File<T>> files;
+};
+
+// Returns the result of `process(pp, path, result)` for the file, which is only called when the file has not been
+// processed in the same state before, and leaves the preprocessor in the state after the file.
+// Returns null for a #pragma once file which has already been included.
+template <typename T, typename Process>
+const T* pp_process_cached(Preprocessor* pp, Pp_File_Cache<T>* cache, const std::string& path, Process process)
+{
+    if (pp->once_files.find(path) != pp->once_files.end())
+    {
+        return 0;
+    }
+
+    std::string key = path;
+    key += '\n';
+    key += pp_serialize_defines(pp->defines);
+    for (const auto& once_file : pp->once_files)
+    {
+        key += once_file;
+        key += '\n';
+    }
+
+    auto cached = cache->files.find(key);
+    if (cached == cache->files.end())
+    {
+        Pp_Cached_File<T> processed;
+        process(pp, path, processed.result);
+        processed.defines_after = pp->defines;
+        processed.once_files_after = pp->once_files;
+        cached = cache->files.emplace(std::move(key), std::move(processed)).first;
+    }
+    else
+    {
+        // Nested #pragma once files are marked as included as well
+        pp->defines = cached->second.defines_after;
+        pp->once_files = cached->second.once_files_after;
+    }
+    return &cached->second.result;
+}
@@ -0,0 +1,389 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// A tokenizer for the declaration parser. Most of the bytes in a shader are function bodies, which
+// we skip wholesale, so the hot loops are the ones that look for the next brace or the next
+// non-whitespace byte. Those are vectorized with SSE2 or AVX2 when available.
+// Define SHD_SCAN_SCALAR to force the scalar implementation.
+
+#if !defined(SHD_SCAN_SCALAR) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define SHD_SCAN_AVX2
+#elif !defined(SHD_SCAN_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define SHD_SCAN_SSE2
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+    inline int scan_ctz(uint32_t mask) { unsigned long index; _BitScanForward(&index, mask); return (int)index; }
+    inline int scan_popcount(uint32_t mask) { return (int)__popcnt(mask); }
+#else
+    inline int scan_ctz(uint32_t mask) { return __builtin_ctz(mask); }
+    inline int scan_popcount(uint32_t mask) { return __builtin_popcount(mask); }
+#endif
+
+inline bool scan_is_whitespace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+// Returns the first byte in [at, end) equal to one of `a`, `b` or `c`, or `end` if there is none.
+// The newlines before the returned position are added to `newlines`.
+// Pass the same character several times to look for fewer than three.
+inline const char* scan_find_scalar(const char* at, const char* end, char a, char b, char c, int* newlines)
+{
+    for (; at < end; at++)
+    {
+        char ch = *at;
+        if (ch == a || ch == b || ch == c)
+        {
+            return at;
+        }
+        *newlines += ch == '\n';
+    }
+    return end;
+}
+
+// Returns the first non-whitespace byte in [at, end), or `end`, counting the skipped newlines.
+inline const char* scan_skip_whitespace_scalar(const char* at, const char* end, int* newlines)
+{
+    for (; at < end && scan_is_whitespace(*at); at++)
+    {
+        *newlines += *at == '\n';
+    }
+    return at;
+}
+
+#if defined(SHD_SCAN_AVX2)
+
+inline const char* scan_find(const char* at, const char* end, char a, char b, char c, int* newlines)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vc = _mm256_set1_epi8(c);
+    const __m256i vn = _mm256_set1_epi8('\n');
+    while (end - at >= 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)at);
+        __m256i stops = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)),
+            _mm256_cmpeq_epi8(chunk, vc));
+        uint32_t stop_mask = (uint32_t)_mm256_movemask_epi8(stops);
+        uint32_t newline_mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, vn));
+        if (stop_mask != 0)
+        {
+            int index = scan_ctz(stop_mask);
+            *newlines += scan_popcount(newline_mask & ((1u << index) - 1));
+            return at + index;
+        }
+        *newlines += scan_popcount(newline_mask);
+        at += 32;
+    }
+    return scan_find_scalar(at, end, a, b, c, newlines);
+}
+
+inline const char* scan_skip_whitespace(const char* at, const char* end, int* newlines)
+{
+    const __m256i vs = _mm256_set1_epi8(' ');
+    const __m256i vt = _mm256_set1_epi8('\t');
+    const __m256i vr = _mm256_set1_epi8('\r');
+    const __m256i vn = _mm256_set1_epi8('\n');
+    while (end - at >= 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)at);
+        __m256i is_newline = _mm256_cmpeq_epi8(chunk, vn);
+        __m256i is_whitespace = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, vs), _mm256_cmpeq_epi8(chunk, vt)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, vr), is_newline));
+        uint32_t other_mask = ~(uint32_t)_mm256_movemask_epi8(is_whitespace);
+        uint32_t newline_mask = (uint32_t)_mm256_movemask_epi8(is_newline);
+        if (other_mask != 0)
+        {
+            int index = scan_ctz(other_mask);
+            *newlines += scan_popcount(newline_mask & ((1u << index) - 1));
+            return at + index;
+        }
+        *newlines += scan_popcount(newline_mask);
+        at += 32;
+    }
+    return scan_skip_whitespace_scalar(at, end, newlines);
+}
+
+#elif defined(SHD_SCAN_SSE2)
+
+inline const char* scan_find(const char* at, const char* end, char a, char b, char c, int* newlines)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i vn = _mm_set1_epi8('\n');
+    while (end - at >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)at);
+        __m128i stops = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+            _mm_cmpeq_epi8(chunk, vc));
+        uint32_t stop_mask = (uint32_t)_mm_movemask_epi8(stops);
+        uint32_t newline_mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, vn));
+        if (stop_mask != 0)
+        {
+            int index = scan_ctz(stop_mask);
+            *newlines += scan_popcount(newline_mask & ((1u << index) - 1));
+            return at + index;
+        }
+        *newlines += scan_popcount(newline_mask);
+        at += 16;
+    }
+    return scan_find_scalar(at, end, a, b, c, newlines);
+}
+
+inline const char* scan_skip_whitespace(const char* at, const char* end, int* newlines)
+{
+    const __m128i vs = _mm_set1_epi8(' ');
+    const __m128i vt = _mm_set1_epi8('\t');
+    const __m128i vr = _mm_set1_epi8('\r');
+    const __m128i vn = _mm_set1_epi8('\n');
+    while (end - at >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)at);
+        __m128i is_newline = _mm_cmpeq_epi8(chunk, vn);
+        __m128i is_whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, vs), _mm_cmpeq_epi8(chunk, vt)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, vr), is_newline));
+        uint32_t other_mask = ~(uint32_t)_mm_movemask_epi8(is_whitespace) & 0xFFFFu;
+        uint32_t newline_mask = (uint32_t)_mm_movemask_epi8(is_newline);
+        if (other_mask != 0)
+        {
+            int index = scan_ctz(other_mask);
+            *newlines += scan_popcount(newline_mask & ((1u << index) - 1));
+            return at + index;
+        }
+        *newlines += scan_popcount(newline_mask);
+        at += 16;
+    }
+    return scan_skip_whitespace_scalar(at, end, newlines);
+}
+
+#else
+
+inline const char* scan_find(const char* at, const char* end, char a, char b, char c, int* newlines)
+{
+    return scan_find_scalar(at, end, a, b, c, newlines);
+}
+
+inline const char* scan_skip_whitespace(const char* at, const char* end, int* newlines)
+{
+    return scan_skip_whitespace_scalar(at, end, newlines);
+}
+
+#endif
+
+
+enum Token_Kind
+{
+    TOKEN_IDENTIFIER,
+    TOKEN_NUMBER,
+    TOKEN_PUNCTUATION, // a single character
+    TOKEN_END
+};
+
+struct Token
+{
+    Token_Kind kind;
+    const char* start;
+    int length;
+    int line;
+};
+
+struct Scanner
+{
+    const char* at;
+    const char* end;
+    const char* path;
+    int line;
+};
+
+inline Scanner scan_create(const char* text, size_t length, const char* path)
+{
+    return Scanner { text, text + length, path, 1 };
+}
+
+inline void scan_error(Scanner* scanner, const char* message, const Token& token)
+{
+    fprintf(stderr, "shd Error: %s, got \"%.*s\" in file %s, line %d.\n",
+        message, token.kind == TOKEN_END ? 3 : token.length, token.kind == TOKEN_END ? "EOF" : token.start,
+        scanner->path, token.line);
+    exit(-1);
+}
+
+inline bool token_is(const Token& token, const char* text)
+{
+    return token.kind != TOKEN_END && strncmp(token.start, text, token.length) == 0 && text[token.length] == 0;
+}
+
+inline bool token_is(const Token& token, char punctuation)
+{
+    return token.kind == TOKEN_PUNCTUATION && *token.start == punctuation;
+}
+
+// Skips whitespace and comments.
+inline void scan_skip_trivia(Scanner* scanner)
+{
+    while (true)
+    {
+        scanner->at = scan_skip_whitespace(scanner->at, scanner->end, &scanner->line);
+        if (scanner->end - scanner->at < 2 || scanner->at[0] != '/')
+        {
+            return;
+        }
+        if (scanner->at[1] == '/')
+        {
+            scanner->at = scan_find(scanner->at + 2, scanner->end, '\n', '\n', '\n', &scanner->line);
+        }
+        else if (scanner->at[1] == '*')
+        {
+            const char* at = scanner->at + 2;
+            while (true)
+            {
+                at = scan_find(at, scanner->end, '*', '*', '*', &scanner->line);
+                if (at == scanner->end)
+                {
+                    break;
+                }
+                at++;
+                if (at < scanner->end && *at == '/')
+                {
+                    at++;
+                    break;
+                }
+            }
+            scanner->at = at;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+inline bool scan_is_identifier_start(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+inline bool scan_is_identifier_char(char ch)
+{
+    return scan_is_identifier_start(ch) || (ch >= '0' && ch <= '9');
+}
+
+inline Token scan_next_token(Scanner* scanner)
+{
+    scan_skip_trivia(scanner);
+
+    Token token;
+    token.start = scanner->at;
+    token.line = scanner->line;
+
+    if (scanner->at == scanner->end)
+    {
+        token.kind = TOKEN_END;
+        token.length = 0;
+        return token;
+    }
+
+    const char* at = scanner->at;
+    if (scan_is_identifier_start(*at))
+    {
+        token.kind = TOKEN_IDENTIFIER;
+        while (at < scanner->end && scan_is_identifier_char(*at))
+        {
+            at++;
+        }
+    }
+    else if (*at >= '0' && *at <= '9')
+    {
+        token.kind = TOKEN_NUMBER;
+        while (at < scanner->end && (scan_is_identifier_char(*at) || *at == '.'))
+        {
+            at++;
+        }
+    }
+    else
+    {
+        token.kind = TOKEN_PUNCTUATION;
+        at++;
+    }
+
+    token.length = (int)(at - scanner->at);
+    scanner->at = at;
+    return token;
+}
+
+inline Token scan_peek_token(Scanner* scanner)
+{
+    Scanner copy = *scanner;
+    return scan_next_token(&copy);
+}
+
+// Skips everything up to and including the `}` matching an already consumed `{`.
+inline void scan_skip_braces(Scanner* scanner)
+{
+    int depth = 1;
+    while (depth > 0)
+    {
+        scanner->at = scan_find(scanner->at, scanner->end, '{', '}', '/', &scanner->line);
+        if (scanner->at == scanner->end)
+        {
+            return;
+        }
+        switch (*scanner->at)
+        {
+            case '{': depth++; scanner->at++; break;
+            case '}': depth--; scanner->at++; break;
+            // Either a comment, which may contain braces, or a division
+            default:
+                if (scanner->end - scanner->at >= 2 && (scanner->at[1] == '/' || scanner->at[1] == '*'))
+                {
+                    scan_skip_trivia(scanner);
+                }
+                else
+                {
+                    scanner->at++;
+                }
+                break;
+        }
+    }
+}
+
+// Skips a declaration or a statement we are not interested in: up to and including the next `;`,
+// or, if a `{` comes first, up to and including the matching `}` (e.g. a function definition).
+inline void scan_skip_statement(Scanner* scanner)
+{
+    while (true)
+    {
+        scanner->at = scan_find(scanner->at, scanner->end, ';', '{', '/', &scanner->line);
+        if (scanner->at == scanner->end)
+        {
+            return;
+        }
+        switch (*scanner->at)
+        {
+            case ';': scanner->at++; return;
+            case '{': scanner->at++; scan_skip_braces(scanner); return;
+            default:
+                if (scanner->end - scanner->at >= 2 && (scanner->at[1] == '/' || scanner->at[1] == '*'))
+                {
+                    scan_skip_trivia(scanner);
+                }
+                else
+                {
+                    scanner->at++;
+                }
+                break;
+        }
+    }
+}
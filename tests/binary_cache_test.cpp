@@ -0,0 +1,108 @@
+// Runs the load_or_link() generated for example/ against the stand-in GL in tests/stub, which accepts only
+// the binaries it returned itself: a miss links and caches the binary, a hit loads it without linking,
+// and a binary cached for other sources, a truncated one or one the driver rejects fall back to linking.
+#include "gl_stub.h"
+#include "example.h"
+#include <stdio.h>
+#include <string>
+
+static int attached = 0;
+static int failures = 0;
+
+static void attach_shaders(GLuint)
+{
+    attached++;
+}
+
+static bool logged(const char* call)
+{
+    return stub_gl_log().find(call) != std::string::npos;
+}
+
+static void check(bool condition, const char* test, const char* what)
+{
+    if (!condition)
+    {
+        printf("binary_cache_test: %s: %s\n", test, what);
+        failures++;
+    }
+}
+
+// Loads the program the way an application would, and checks whether it was linked or loaded from the cache
+static void load(const char* test, const char* path, bool expect_link)
+{
+    stub_gl_calls = 0;
+    attached = 0;
+    stub_gl_logging = true;
+    Example_Program program;
+    bool loaded = program.load_or_link(path, attach_shaders);
+    check(loaded, test, "load_or_link() failed");
+    check(program.id != 0, test, "no program");
+    check(logged("glLinkProgram") == expect_link, test, expect_link ? "not linked" : "linked instead of loaded");
+    check((attached == 1) == expect_link, test, expect_link ? "shaders not attached" : "shaders attached");
+    check(stub_gl_live_programs() == 1, test, "a program leaked");
+    glDeleteProgram(program.id);
+}
+
+// Rewrites the cache file, keeping `keep` bytes and then writing `data`
+static void rewrite(const char* path, long keep, const void* data, size_t size)
+{
+    FILE* file = fopen(path, "rb");
+    std::string contents(4096, '\0');
+    contents.resize(fread(&contents[0], 1, contents.size(), file));
+    fclose(file);
+    contents.resize(keep);
+    contents.append((const char*)data, size);
+    file = fopen(path, "wb");
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+}
+
+int main()
+{
+    std::string path = std::string(P_tmpdir) + "/shd_binary_cache_test.bin";
+    remove(path.c_str());
+    stub_gl_reset();
+
+    load("miss", path.c_str(), true);
+    stub_gl_reset();
+    load("hit", path.c_str(), false);
+
+    // The first 8 bytes are the source hash
+    unsigned long long other_hash = Example_Program::source_hash ^ 1;
+    rewrite(path.c_str(), 0, &other_hash, sizeof(other_hash));
+    stub_gl_reset();
+    load("stale", path.c_str(), true);
+    stub_gl_reset();
+    load("hit after stale", path.c_str(), false);
+
+    rewrite(path.c_str(), sizeof(unsigned long long) + 2, "", 0);
+    stub_gl_reset();
+    load("truncated", path.c_str(), true);
+
+    stub_gl_reset();
+    stub_gl_rejects_binaries = true;
+    load("rejected", path.c_str(), true);
+    check(logged("glProgramBinary"), "rejected", "the binary was not tried");
+
+    remove(path.c_str());
+    stub_gl_reset();
+    stub_gl_link_fails = true;
+    Example_Program program;
+    check(!program.load_or_link(path.c_str(), attach_shaders), "link failure", "load_or_link() succeeded");
+    check(stub_gl_live_programs() == 0, "link failure", "the program leaked");
+    FILE* cached = fopen(path.c_str(), "rb");
+    check(cached == NULL, "link failure", "a binary was cached");
+    if (cached != NULL)
+    {
+        fclose(cached);
+    }
+
+    remove(path.c_str());
+    if (failures > 0)
+    {
+        return 1;
+    }
+    puts("binary_cache_test: passed");
+    return 0;
+}
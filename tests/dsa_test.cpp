@@ -0,0 +1,85 @@
+// Runs the code generated for example/ with the DSA backend against the stand-in GL in tests/stub, and
+// compares the calls it makes with the expected sequence. Setting uniforms and block members must not
+// bind the program or the buffer.
+#include "gl_stub.h"
+#include "example.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* expected =
+    "glGetUniformLocation(7, \"bar\")\n"
+    "glGetUniformLocation(7, \"baz\")\n"
+    "glGetUniformLocation(7, \"foo\")\n"
+    "glGetUniformLocation(7, \"thing.test\")\n"
+    "glGetUniformLocation(7, \"thing.foo\")\n"
+    "glGetUniformLocation(7, \"thing.bar\")\n"
+    "glGetUniformBlockIndex(7, \"Stuff\")\n"
+    "glGetUniformBlockIndex(7, \"Stuff_2\")\n"
+    "glProgramUniform1f(7, 0, 1.5)\n"
+    "glProgramUniform3fv(7, 2, 1, {1, 2, 3})\n"
+    "glProgramUniformMatrix4fv(7, 1, 1, 0, {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1})\n"
+    "glProgramUniform3fv(7, 3, 1, {4, 5, 6})\n"
+    "glProgramUniform2fv(7, 4, 1, {7, 8})\n"
+    "glProgramUniformMatrix4fv(7, 5, 1, 0, {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1})\n"
+    "glCreateBuffers(1)\n"
+    "glNamedBufferData(1, 112, NULL, 0x88e4)\n"
+    "glBindBufferBase(0x8a11, 3, 1)\n"
+    "glUniformBlockBinding(7, 6, 3)\n"
+    "glNamedBufferSubData(1, 16, 16)\n"
+    "glNamedBufferSubData(1, 48, 64)\n"
+    "glNamedBufferSubData(1, 0, 112)\n";
+
+// Prints the first line which differs
+static void print_difference(const char* expected, const char* actual)
+{
+    int line = 1;
+    while (*expected != '\0' || *actual != '\0')
+    {
+        const char* expected_end = strchr(expected, '\n');
+        const char* actual_end = strchr(actual, '\n');
+        size_t expected_length = expected_end ? expected_end - expected : strlen(expected);
+        size_t actual_length = actual_end ? actual_end - actual : strlen(actual);
+        if (expected_length != actual_length || memcmp(expected, actual, expected_length) != 0)
+        {
+            printf("dsa_test: line %d differs\n  expected: %.*s\n  actual:   %.*s\n",
+                line, (int)expected_length, expected, (int)actual_length, actual);
+            return;
+        }
+        expected += expected_length + (expected_end ? 1 : 0);
+        actual += actual_length + (actual_end ? 1 : 0);
+        line++;
+    }
+}
+
+int main()
+{
+    stub_gl_reset();
+    stub_gl_logging = true;
+
+    glm::mat4 identity = { { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } } };
+
+    Example_Program program;
+    program.id = 7;
+    program.query_locations();
+    program.bar(1.5f);
+    program.foo({ 1, 2, 3 });
+    program.baz(identity);
+    program.thing({ { 4, 5, 6 }, { 7, 8 }, identity });
+
+    Stuff_Block stuff;
+    stuff.create(3);
+    program.Stuff_block(stuff);
+    stuff.fee({ 1, 2, 3, 4 });
+    stuff.too(identity);
+    Stuff data = {};
+    stuff.data(&data);
+
+    const std::string& actual = stub_gl_log();
+    if (actual != expected)
+    {
+        print_difference(expected, actual.c_str());
+        return 1;
+    }
+    printf("dsa_test: %d calls as expected\n", (int)stub_gl_calls);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Runs the code generated for example/ with the DSA backend and --stats against the stand-in GL in tests/stub,
+// which reports "foo" and every member of "thing" as removed by the linker. Their setters, and uniforms(),
+// must make no GL call for them, and report_inactive() must list them. Built with SHD_STATS.
+#include "gl_stub.h"
+#include "example.h"
+#include <stdio.h>
+#include <string>
+#ifdef _WIN32
+#include <io.h>
+#define dup_file(fd) _dup(fd)
+#define dup2_file(fd, fd2) _dup2(fd, fd2)
+#define close_file(fd) _close(fd)
+#define file_number(file) _fileno(file)
+#else
+#include <unistd.h>
+#define dup_file(fd) dup(fd)
+#define dup2_file(fd, fd2) dup2(fd, fd2)
+#define close_file(fd) close(fd)
+#define file_number(file) fileno(file)
+#endif
+
+static int failures = 0;
+
+static void check(bool condition, const char* test, const char* what)
+{
+    if (!condition)
+    {
+        printf("inactive_test: %s: %s\n", test, what);
+        failures++;
+    }
+}
+
+// Runs report_inactive() with stdout redirected to a file, and returns what it printed
+static std::string report_inactive(Example_Program& program)
+{
+    const char* path = "inactive_test_report.txt";
+    fflush(stdout);
+    int saved = dup_file(file_number(stdout));
+    if (freopen(path, "w", stdout) == 0)
+    {
+        return "";
+    }
+    program.report_inactive();
+    fflush(stdout);
+    dup2_file(saved, file_number(stdout));
+    close_file(saved);
+
+    std::string result;
+    FILE* file = fopen(path, "r");
+    if (file != 0)
+    {
+        char buffer[256];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            result.append(buffer, read);
+        }
+        fclose(file);
+    }
+    remove(path);
+    return result;
+}
+
+int main()
+{
+    stub_gl_reset();
+    stub_gl_inactive_uniforms = { "foo", "thing.test", "thing.foo", "thing.bar" };
+
+    glm::mat4 identity = { { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } } };
+    Thing thing = { { 4, 5, 6 }, { 7, 8 }, identity };
+
+    Example_Program program;
+    program.id = 7;
+    program.query_locations();
+
+    stub_gl_logging = true;
+    program.foo({ 1, 2, 3 });
+    program.thing(thing);
+    check(stub_gl_log().empty(), "setters", "the setters of removed uniforms made GL calls");
+
+    program.uniforms(1.5f, identity, { 1, 2, 3 }, thing);
+    check(stub_gl_log() == "glProgramUniform1f(7, 0, 1.5)\n"
+        "glProgramUniformMatrix4fv(7, 1, 1, 0, {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1})\n",
+        "uniforms()", "only bar and baz should be set");
+
+    std::string report = report_inactive(program);
+    check(report == "Example_Program: inactive uniform foo\nExample_Program: inactive uniform thing\n",
+        "report_inactive()", "foo and thing should be listed, and only them");
+
+    if (failures > 0)
+    {
+        printf("%s", stub_gl_log().c_str());
+        printf("%s", report.c_str());
+        return 1;
+    }
+    puts("inactive_test: passed");
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Runs the pack() kernels generated for tests/shaders/pack.vs on random records, and compares every member
+// with a copy made column by column. The same test is built with SSE2, with AVX and with SHD_PACK_SCALAR.
+// The padding is not compared, since the vector code may write anything there, but nothing may be written
+// after the last record.
+#include "buffers.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+static int failures = 0;
+
+// A member of a block: where it is in the source and in the block record, and its columns
+struct Field
+{
+    const char* name;
+    size_t source;
+    size_t target;
+    size_t column_count;
+    size_t column_size;
+};
+
+#define FIELD(block, member, column_count, column_size) \
+    { #member, offsetof(block##_Source, member), offsetof(block, member), column_count, column_size }
+
+template <class Source>
+static void check(const char* block, std::vector<Field> fields, size_t stride)
+{
+    if (Source::block_stride != stride)
+    {
+        printf("pack_test: %s: the stride is %zu instead of %zu\n", block, Source::block_stride, stride);
+        failures++;
+    }
+    const size_t guard = 64;
+    for (size_t n : { 0, 1, 2, 7 })
+    {
+        std::vector<Source> source(n);
+        for (size_t i = 0; i < n * sizeof(Source) / sizeof(float); i++)
+        {
+            ((float*)source.data())[i] = (float)rand() / RAND_MAX;
+        }
+        std::vector<char> packed(n * stride + guard, 0x5a);
+        pack(source.data(), n, packed.data());
+
+        for (size_t i = 0; i < n; i++)
+        {
+            const char* in = (const char*)&source[i];
+            const char* out = packed.data() + i * stride;
+            for (const auto& field : fields)
+            {
+                for (size_t column = 0; column < field.column_count; column++)
+                {
+                    if (memcmp(out + field.target + column * 16, in + field.source + column * field.column_size,
+                        field.column_size) != 0)
+                    {
+                        printf("pack_test: %s: record %zu of %zu, %s, column %zu differs\n", block, i, n, field.name, column);
+                        failures++;
+                    }
+                }
+            }
+        }
+        for (size_t i = n * stride; i < packed.size(); i++)
+        {
+            if (packed[i] != 0x5a)
+            {
+                printf("pack_test: %s: %zu records write past the end\n", block, n);
+                failures++;
+                break;
+            }
+        }
+    }
+}
+
+int main()
+{
+    check<Vectors_Source>("Vectors", { FIELD(Vectors, a, 1, 12), FIELD(Vectors, b, 1, 12) }, 32);
+    check<Light_Source>("Light",
+        { FIELD(Light, position, 1, 12), FIELD(Light, radius, 1, 4), FIELD(Light, uv, 1, 8), FIELD(Light, color, 1, 16) }, 48);
+    check<Matrices_Source>("Matrices",
+        { FIELD(Matrices, normal_matrix, 3, 12), FIELD(Matrices, model, 1, 64), FIELD(Matrices, scale, 1, 4) }, 128);
+    check<Direction_Source>("Direction", { FIELD(Direction, direction, 1, 12) }, 16);
+    check<Transform_Source>("Transform", { FIELD(Transform, offset, 1, 8), FIELD(Transform, rotation, 3, 12) }, 64);
+
+    if (failures > 0)
+    {
+        return 1;
+    }
+#if defined(SHD_PACK_AVX)
+    puts("pack_test (AVX): passed");
+#elif defined(SHD_PACK_SSE2)
+    puts("pack_test (SSE2): passed");
+#else
+    puts("pack_test (scalar): passed");
+#endif
+    return 0;
+}
@@ -0,0 +1,216 @@
+// Tests of the preprocessor: the line reading (lines longer than the read buffer, line continuations
+// and /* */ comments across lines, which must neither split nor drop declarations), #if and #elif,
+// the resolution of #include and the cache of processed files.
+#include "../src/preprocessor.h"
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#define remove_directory(path) _rmdir(path)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define make_directory(path) mkdir(path, 0777)
+#define remove_directory(path) rmdir(path)
+#endif
+
+int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { fprintf(stderr, "preprocessor_test: %s failed, line %d\n", #condition, __LINE__); failures++; }
+
+void write_file(const char* path, const std::string& text)
+{
+    FILE* file = fopen(path, "w");
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+}
+
+// Preprocesses the file and returns the active lines, joined. An #include ends it with "include <path>".
+std::string preprocess_file(Preprocessor* pp, const char* path)
+{
+    Pp_Source source = pp_open(path);
+    std::string result;
+    std::string line;
+    std::string include_path;
+    Pp_Line_Kind kind;
+    while ((kind = pp_next_line(pp, &source, &line, &include_path)) == PP_LINE)
+    {
+        result += line;
+    }
+    if (kind == PP_INCLUDE)
+    {
+        result += "include " + include_path;
+    }
+    pp_close(&source);
+    return result;
+}
+
+// Preprocesses the text and returns the active lines, joined
+std::string preprocess(const std::string& text)
+{
+    const char* path = "preprocessor_test.glsl";
+    write_file(path, text);
+    Preprocessor pp;
+    std::string result = preprocess_file(&pp, path);
+    remove(path);
+    return result;
+}
+
+void test_conditionals()
+{
+    std::string conditionals = 
+        "#if QUALITY >= 2 && defined(USE_FOG)\nuniform float high_fog;\n"
+        "#elif QUALITY == 1 || (QUALITY > 2)\nuniform float low;\n"
+        "#elif !defined USE_FOG\nuniform float no_fog;\n"
+        "#else\nuniform float other;\n#endif\n";
+    CHECK(preprocess("#define QUALITY 2\n#define USE_FOG\n" + conditionals) == "uniform float high_fog;\n");
+    CHECK(preprocess("#define QUALITY 1\n#define USE_FOG\n" + conditionals) == "uniform float low;\n");
+    CHECK(preprocess("#define QUALITY 3\n" + conditionals) == "uniform float low;\n");
+    CHECK(preprocess("#define QUALITY 0\n" + conditionals) == "uniform float no_fog;\n");
+    CHECK(preprocess("#define QUALITY 0\n#define USE_FOG\n" + conditionals) == "uniform float other;\n");
+
+    // An #elif after a taken branch is not evaluated, and nested conditionals of inactive branches are skipped
+    CHECK(preprocess("#if 1\nuniform float a;\n#elif 1 / 0\n#endif\n") == "uniform float a;\n");
+    CHECK(preprocess("#if 0\n#if 1\nuniform float a;\n#endif\n#else\nuniform float b;\n#endif\n") 
+        == "uniform float b;\n");
+    CHECK(preprocess("#define SHIFT (1 << 3)\n#if SHIFT % 5 == 3 && -1 < 0\nuniform float c;\n#endif\n")
+        == "uniform float c;\n");
+}
+
+void test_includes()
+{
+    make_directory("pp_test");
+    make_directory("pp_test/shaders");
+    make_directory("pp_test/first");
+    make_directory("pp_test/second");
+    write_file("pp_test/shaders/common.glsl", "");
+    write_file("pp_test/first/common.glsl", "");
+    write_file("pp_test/first/only_first.glsl", "");
+    write_file("pp_test/second/common.glsl", "");
+    write_file("pp_test/second/only_second.glsl", "");
+
+    Preprocessor pp;
+    pp.include_paths = { "pp_test/first", "pp_test/second/" };
+    const char* path = "pp_test/shaders/main.glsl";
+
+    // Quoted includes are looked up next to the including file first
+    write_file(path, "#include \"common.glsl\"\n");
+    CHECK(preprocess_file(&pp, path) == "include pp_test/shaders/common.glsl");
+    write_file(path, "#include \"only_second.glsl\"\n");
+    CHECK(preprocess_file(&pp, path) == "include pp_test/second/only_second.glsl");
+
+    // Angled includes are only looked up in the include paths, in the order they are given
+    write_file(path, "#include <common.glsl>\n");
+    CHECK(preprocess_file(&pp, path) == "include pp_test/first/common.glsl");
+    pp.include_paths = { "pp_test/second", "pp_test/first" };
+    CHECK(preprocess_file(&pp, path) == "include pp_test/second/common.glsl");
+    write_file(path, "#include <only_first.glsl>\n");
+    CHECK(preprocess_file(&pp, path) == "include pp_test/first/only_first.glsl");
+
+    // Inactive includes are not resolved
+    write_file(path, "#ifdef MISSING\n#include \"missing.glsl\"\n#endif\nuniform float a;\n");
+    CHECK(preprocess_file(&pp, path) == "uniform float a;\n");
+
+    remove(path);
+    remove("pp_test/shaders/common.glsl");
+    remove("pp_test/first/common.glsl");
+    remove("pp_test/first/only_first.glsl");
+    remove("pp_test/second/common.glsl");
+    remove("pp_test/second/only_second.glsl");
+    remove_directory("pp_test/shaders");
+    remove_directory("pp_test/first");
+    remove_directory("pp_test/second");
+    remove_directory("pp_test");
+}
+
+int processed = 0;
+
+const std::string* process_cached(Preprocessor* pp, Pp_File_Cache<std::string>* cache, const char* path)
+{
+    return pp_process_cached(pp, cache, path, [](Preprocessor* pp, const std::string& path, std::string& result)
+    {
+        processed++;
+        result = preprocess_file(pp, path.c_str());
+    });
+}
+
+void test_cache()
+{
+    const char* path = "preprocessor_test_cached.glsl";
+    write_file(path, "#define INCLUDED\n#ifdef FOG\nuniform float fog;\n#endif\nuniform float a;\n");
+    Pp_File_Cache<std::string> cache;
+
+    // The same macros hit the cache, and the macros the file defines are restored
+    Preprocessor pp;
+    const std::string* first = process_cached(&pp, &cache, path);
+    CHECK(processed == 1 && *first == "uniform float a;\n");
+    pp.defines.clear();
+    const std::string* hit = process_cached(&pp, &cache, path);
+    CHECK(processed == 1 && hit == first);
+    CHECK(pp.defines.find("INCLUDED") != pp.defines.end());
+
+    // Other macros miss it, since they can change the result
+    Preprocessor fog;
+    fog.defines["FOG"] = {};
+    const std::string* with_fog = process_cached(&fog, &cache, path);
+    CHECK(processed == 2 && *with_fog == "uniform float fog;\nuniform float a;\n");
+    fog.defines.erase("INCLUDED");
+    CHECK(process_cached(&fog, &cache, path) == with_fog && processed == 2);
+    fog.defines["FOG"] = { "1", false };
+    process_cached(&fog, &cache, path);
+    CHECK(processed == 3);
+
+    // A #pragma once file is skipped once included, also when it came from the cache
+    const char* once_path = "preprocessor_test_once.glsl";
+    write_file(once_path, "#pragma once\nuniform float once;\n");
+    Preprocessor once;
+    CHECK(process_cached(&once, &cache, once_path) != 0 && processed == 4);
+    CHECK(process_cached(&once, &cache, once_path) == 0 && processed == 4);
+    Preprocessor again;
+    CHECK(process_cached(&again, &cache, once_path) != 0 && processed == 4);
+    CHECK(process_cached(&again, &cache, once_path) == 0);
+
+    remove(path);
+    remove(once_path);
+}
+
+int main()
+{
+    // A declaration after a comment longer than the 1024-byte read buffer
+    std::string long_comment = "/*" + std::string(1019, 'x') + "*/";
+    std::string result = preprocess(long_comment + " uniform vec3 longline_uniform;\n");
+    CHECK(result.find("uniform vec3 longline_uniform;") != std::string::npos);
+    CHECK(result.find('x') == std::string::npos);
+
+    std::string long_line = "uniform float a; // " + std::string(3000, 'y') + "\nuniform float b;\n";
+    result = preprocess(long_line);
+    CHECK(result == long_line);
+
+    // Macros expand to lines longer than the buffer
+    result = preprocess("#define LONG " + std::string(2000, 'z') + "\nLONG uniform float c;\n");
+    CHECK(result == std::string(2000, 'z') + " uniform float c;\n");
+
+    result = preprocess("#define A \\\n    1\n#if A\nuniform float continued;\n#endif\n");
+    CHECK(result == "uniform float continued;\n");
+
+    result = preprocess("/* start\n#define B 1\n*/\n#ifdef B\nuniform float commented_out;\n#endif\n");
+    CHECK(result.find("commented_out") == std::string::npos);
+
+    result = preprocess("#define C 1 /* a\n   b */\n#if C\nuniform float after_comment;\n#endif\n");
+    CHECK(result.find("after_comment") != std::string::npos);
+
+    // Line comments stay, since annotations live in them
+    result = preprocess("uniform mat4 view; // @frequency(frame)\n");
+    CHECK(result == "uniform mat4 view; // @frequency(frame)\n");
+
+    test_conditionals();
+    test_includes();
+    test_cache();
+
+    if (failures > 0)
+    {
+        return 1;
+    }
+    printf("preprocessor_test: passed\n");
+    return 0;
+}
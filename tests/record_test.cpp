@@ -0,0 +1,104 @@
+// Runs the code generated for example/ with the DSA backend and --record against the stand-in GL in tests/stub.
+// A producer thread records draws into streams and hands them over through a Shd_Command_Queue small enough
+// to fill up, while the main thread replays them. The GL calls must be the ones the same setters make when
+// they are called directly, in the same order.
+#include "gl_stub.h"
+#include "example.h"
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+static const int streams = 500;
+static const int draws_per_stream = 3;
+
+// The values of every draw are different, and baz is only set in some of them
+template <class Setters>
+static void set_draw(Setters& setters, int stream, int draw)
+{
+    float value = (float)(stream * draws_per_stream + draw);
+    setters.bar(value);
+    if (draw == 0)
+    {
+        setters.baz({ { { value, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } } });
+    }
+    setters.foo({ value, value + 1, value + 2 });
+    setters.thing({ { value, 0, 0 }, { 0, value }, { { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, value } } } });
+}
+
+static void produce(Shd_Command_Queue* queue)
+{
+    for (int i = 0; i < streams; i++)
+    {
+        Shd_Command_Stream* stream = new Shd_Command_Stream { 0, 0, 0 };
+        Example_Recorder recorder { stream };
+        for (int draw = 0; draw < draws_per_stream; draw++)
+        {
+            set_draw(recorder, i, draw);
+            recorder.end_draw();
+        }
+        while (!shd_queue_push(queue, stream))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int main()
+{
+    Example_Program program;
+    program.id = 7;
+
+    // The calls of the setters themselves
+    stub_gl_reset();
+    program.query_locations();
+    stub_gl_logging = true;
+    for (int i = 0; i < streams; i++)
+    {
+        for (int draw = 0; draw < draws_per_stream; draw++)
+        {
+            set_draw(program, i, draw);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }
+    std::string expected = stub_gl_log();
+
+    // The same calls, recorded on another thread
+    stub_gl_reset();
+    program.query_locations();
+    stub_gl_logging = true;
+    Shd_Command_Queue queue;
+    std::thread producer(produce, &queue);
+    int replayed = 0;
+    while (replayed < streams)
+    {
+        Shd_Command_Stream* stream = shd_queue_pop(&queue);
+        if (stream == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        size_t at = 0;
+        while (at < stream->size)
+        {
+            at = program.replay(stream, at);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        free(stream->data);
+        delete stream;
+        replayed++;
+    }
+    producer.join();
+
+    if (stub_gl_log() != expected)
+    {
+        printf("record_test: the replayed calls differ from the calls of the setters\n");
+        return 1;
+    }
+    if (shd_queue_pop(&queue) != 0)
+    {
+        printf("record_test: the queue is not empty after the last stream\n");
+        return 1;
+    }
+    printf("record_test: %d draws replayed as expected\n", streams * draws_per_stream);
+    return 0;
+}
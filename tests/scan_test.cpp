@@ -0,0 +1,80 @@
+// Differential test of the vectorized scan_find and scan_skip_whitespace against the scalar versions.
+// Built once with the default vector extensions (SSE2 on x64) and once with AVX2, see premake5.lua.
+#include "../src/scan.h"
+
+int failures = 0;
+
+void check(bool condition, const char* what, size_t offset, size_t length)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "scan_test: %s differs at offset %zu, length %zu\n", what, offset, length);
+        failures++;
+    }
+}
+
+int main()
+{
+#if defined(SHD_SCAN_AVX2)
+    const char* implementation = "AVX2";
+#elif defined(SHD_SCAN_SSE2)
+    const char* implementation = "SSE2";
+#else
+    const char* implementation = "scalar";
+#endif
+
+    // Mostly whitespace and identifier bytes, with the occasional brace, so that the
+    // stops land on every position of a vector and runs cross the vector boundaries.
+    const char alphabet[] = "    \t\t\r\n\n\nabcx_;{}";
+    const size_t size = 4096;
+    char text[size];
+    uint32_t state = 12345;
+    int cases = 0;
+    for (int round = 0; round < 64; round++)
+    {
+        int density = 1 + round % 8;
+        for (size_t i = 0; i < size; i++)
+        {
+            state = state * 1664525u + 1013904223u;
+            uint32_t pick = (state >> 8) % (sizeof(alphabet) - 1);
+            // Lower densities are mostly whitespace, so that long runs are skipped
+            text[i] = (int)(pick % 8) < density ? alphabet[pick] : (pick % 2 ? ' ' : '\n');
+        }
+
+        for (size_t offset = 0; offset < 80; offset++)
+        {
+            for (size_t length = 0; offset + length <= size; length += 1 + length / 3)
+            {
+                const char* at = text + offset;
+                const char* end = at + length;
+
+                int vector_newlines = 0;
+                int scalar_newlines = 0;
+                const char* vector = scan_find(at, end, '{', '}', '{', &vector_newlines);
+                const char* scalar = scan_find_scalar(at, end, '{', '}', '{', &scalar_newlines);
+                check(vector == scalar && vector_newlines == scalar_newlines, "scan_find", offset, length);
+
+                vector_newlines = 0;
+                scalar_newlines = 0;
+                vector = scan_find(at, end, '\n', '\n', '\n', &vector_newlines);
+                scalar = scan_find_scalar(at, end, '\n', '\n', '\n', &scalar_newlines);
+                check(vector == scalar && vector_newlines == scalar_newlines, "scan_find newline", offset, length);
+
+                vector_newlines = 0;
+                scalar_newlines = 0;
+                vector = scan_skip_whitespace(at, end, &vector_newlines);
+                scalar = scan_skip_whitespace_scalar(at, end, &scalar_newlines);
+                check(vector == scalar && vector_newlines == scalar_newlines, "scan_skip_whitespace", offset, length);
+                cases++;
+            }
+        }
+    }
+
+    if (failures > 0)
+    {
+        fprintf(stderr, "scan_test (%s): %d of %d cases failed\n", implementation, failures, cases);
+        return 1;
+    }
+    printf("scan_test (%s): %d cases passed\n", implementation, cases);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#version 330 core
+
+// Blocks whose std140 layout differs from the tightly packed CPU layout, see tests/pack_test.cpp
+
+// The second vec3 ends the source record, so it is loaded with the 4 bytes before it
+layout (std140) uniform Vectors
+{
+    vec3 a;
+    vec3 b;
+};
+
+// The float after the vec3 and the vec2 after it are contiguous in both layouts
+layout (std140) uniform Light
+{
+    vec3 position;
+    float radius;
+    vec2 uv;
+    vec4 color;
+};
+
+// The columns of the mat3 are padded, the mat4 is moved in 32-byte chunks with AVX
+layout (std140) uniform Matrices
+{
+    mat3 normal_matrix;
+    mat4 model;
+    float scale;
+};
+
+// A record smaller than 16 bytes
+layout (std140) uniform Direction
+{
+    vec3 direction;
+};
+
+// The mat3 ends the source record
+layout (std140) uniform Transform
+{
+    vec2 offset;
+    mat3 rotation;
+};
+
+void main()
+{
+}
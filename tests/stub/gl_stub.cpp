@@ -0,0 +1,354 @@
+#include "gl_stub.h"
+#include <map>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+unsigned long long stub_gl_calls = 0;
+bool stub_gl_logging = false;
+std::set<std::string> stub_gl_inactive_uniforms;
+bool stub_gl_link_fails = false;
+bool stub_gl_rejects_binaries = false;
+
+static std::string call_log;
+static std::map<std::string, GLint> locations;
+static std::map<GLuint, GLint> link_status;
+static GLuint next_name = 1;
+static GLuint current_program = 0;
+
+// What glGetProgramBinary returns, and the only binary glProgramBinary accepts
+static const char stub_binary[] = "stub binary";
+static const GLenum stub_binary_format = 0x5354;
+
+void stub_gl_reset()
+{
+    stub_gl_calls = 0;
+    stub_gl_logging = false;
+    stub_gl_inactive_uniforms.clear();
+    stub_gl_link_fails = false;
+    stub_gl_rejects_binaries = false;
+    call_log.clear();
+    locations.clear();
+    link_status.clear();
+    next_name = 1;
+    current_program = 0;
+}
+
+const std::string& stub_gl_log()
+{
+    return call_log;
+}
+
+int stub_gl_live_programs()
+{
+    return (int)link_status.size();
+}
+
+static void call(const char* format, ...)
+{
+    stub_gl_calls++;
+    if (!stub_gl_logging)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    char buffer[1024];
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    call_log += buffer;
+    call_log += '\n';
+}
+
+// Formats the values a pointer argument points to, e.g. {1, 2, 3}
+static std::string values(const GLfloat* value, int count)
+{
+    if (!stub_gl_logging)
+    {
+        return std::string();
+    }
+    std::string result = "{";
+    for (int i = 0; i < count; i++)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), i == 0 ? "%g" : ", %g", value[i]);
+        result += buffer;
+    }
+    return result + "}";
+}
+
+void glUseProgram(GLuint program)
+{
+    call("glUseProgram(%u)", program);
+    current_program = program;
+}
+
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    call("glDrawArrays(0x%x, %d, %d)", mode, first, count);
+}
+
+// Locations and block indices are handed out in the order the names are first queried
+static GLint location_of(const char* name)
+{
+    if (stub_gl_inactive_uniforms.count(name) != 0)
+    {
+        return -1;
+    }
+    auto location = locations.find(name);
+    if (location == locations.end())
+    {
+        location = locations.insert({ name, (GLint)locations.size() }).first;
+    }
+    return location->second;
+}
+
+GLint glGetUniformLocation(GLuint program, const char* name)
+{
+    call("glGetUniformLocation(%u, \"%s\")", program, name);
+    return location_of(name);
+}
+
+GLuint glGetUniformBlockIndex(GLuint program, const char* name)
+{
+    call("glGetUniformBlockIndex(%u, \"%s\")", program, name);
+    return (GLuint)location_of(name);
+}
+
+void glUniformBlockBinding(GLuint program, GLuint index, GLuint binding)
+{
+    call("glUniformBlockBinding(%u, %u, %u)", program, index, binding);
+}
+
+void glUniform1f(GLint location, GLfloat value)
+{
+    call("glUniform1f(%d, %g)", location, value);
+}
+
+void glUniform1i(GLint location, GLint value)
+{
+    call("glUniform1i(%d, %d)", location, value);
+}
+
+void glUniform2fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    call("glUniform2fv(%d, %d, %s)", location, count, values(value, 2 * count).c_str());
+}
+
+void glUniform3fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    call("glUniform3fv(%d, %d, %s)", location, count, values(value, 3 * count).c_str());
+}
+
+void glUniform4fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    call("glUniform4fv(%d, %d, %s)", location, count, values(value, 4 * count).c_str());
+}
+
+void glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+    call("glUniformMatrix3fv(%d, %d, %d, %s)", location, count, transpose, values(value, 9 * count).c_str());
+}
+
+void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+    call("glUniformMatrix4fv(%d, %d, %d, %s)", location, count, transpose, values(value, 16 * count).c_str());
+}
+
+void glUniformHandleui64ARB(GLint location, GLuint64 value)
+{
+    call("glUniformHandleui64ARB(%d, %llu)", location, (unsigned long long)value);
+}
+
+void glProgramUniform1f(GLuint program, GLint location, GLfloat value)
+{
+    call("glProgramUniform1f(%u, %d, %g)", program, location, value);
+}
+
+void glProgramUniform1i(GLuint program, GLint location, GLint value)
+{
+    call("glProgramUniform1i(%u, %d, %d)", program, location, value);
+}
+
+void glProgramUniform2fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+    call("glProgramUniform2fv(%u, %d, %d, %s)", program, location, count, values(value, 2 * count).c_str());
+}
+
+void glProgramUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+    call("glProgramUniform3fv(%u, %d, %d, %s)", program, location, count, values(value, 3 * count).c_str());
+}
+
+void glProgramUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+{
+    call("glProgramUniform4fv(%u, %d, %d, %s)", program, location, count, values(value, 4 * count).c_str());
+}
+
+void glProgramUniformMatrix3fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+    call("glProgramUniformMatrix3fv(%u, %d, %d, %d, %s)", program, location, count, transpose, values(value, 9 * count).c_str());
+}
+
+void glProgramUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+    call("glProgramUniformMatrix4fv(%u, %d, %d, %d, %s)", program, location, count, transpose, values(value, 16 * count).c_str());
+}
+
+void glProgramUniformHandleui64ARB(GLuint program, GLint location, GLuint64 value)
+{
+    call("glProgramUniformHandleui64ARB(%u, %d, %llu)", program, location, (unsigned long long)value);
+}
+
+void glGenBuffers(GLsizei n, GLuint* buffers)
+{
+    call("glGenBuffers(%d)", n);
+    for (GLsizei i = 0; i < n; i++)
+    {
+        buffers[i] = next_name++;
+    }
+}
+
+void glCreateBuffers(GLsizei n, GLuint* buffers)
+{
+    call("glCreateBuffers(%d)", n);
+    for (GLsizei i = 0; i < n; i++)
+    {
+        buffers[i] = next_name++;
+    }
+}
+
+void glDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+    call("glDeleteBuffers(%d, %u)", n, n > 0 ? buffers[0] : 0);
+}
+
+void glBindBuffer(GLenum target, GLuint buffer)
+{
+    call("glBindBuffer(0x%x, %u)", target, buffer);
+}
+
+void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+    call("glBufferData(0x%x, %td, %s, 0x%x)", target, size, data ? "data" : "NULL", usage);
+}
+
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void*)
+{
+    call("glBufferSubData(0x%x, %td, %td)", target, offset, size);
+}
+
+void glNamedBufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage)
+{
+    call("glNamedBufferData(%u, %td, %s, 0x%x)", buffer, size, data ? "data" : "NULL", usage);
+}
+
+void glNamedBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void*)
+{
+    call("glNamedBufferSubData(%u, %td, %td)", buffer, offset, size);
+}
+
+void glBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    call("glBindBufferBase(0x%x, %u, %u)", target, index, buffer);
+}
+
+void glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    call("glBindBufferRange(0x%x, %u, %u, %td, %td)", target, index, buffer, offset, size);
+}
+
+void glGetIntegerv(GLenum name, GLint* data)
+{
+    call("glGetIntegerv(0x%x)", name);
+    *data = name == GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT ? 256 : name == GL_CURRENT_PROGRAM ? (GLint)current_program : 0;
+}
+
+void glActiveTexture(GLenum texture)
+{
+    call("glActiveTexture(GL_TEXTURE0 + %u)", texture - GL_TEXTURE0);
+}
+
+void glBindTexture(GLenum target, GLuint texture)
+{
+    call("glBindTexture(0x%x, %u)", target, texture);
+}
+
+void glBindTextureUnit(GLuint unit, GLuint texture)
+{
+    call("glBindTextureUnit(%u, %u)", unit, texture);
+}
+
+void glBindImageTexture(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format)
+{
+    call("glBindImageTexture(%u, %u, %d, %d, %d, 0x%x, 0x%x)", unit, texture, level, layered, layer, access, format);
+}
+
+// Every texture is GL_RGBA8
+void glGetTextureLevelParameteriv(GLuint texture, GLint level, GLenum name, GLint* params)
+{
+    call("glGetTextureLevelParameteriv(%u, %d, 0x%x)", texture, level, name);
+    *params = name == GL_TEXTURE_INTERNAL_FORMAT ? GL_RGBA8 : 0;
+}
+
+GLuint glCreateProgram()
+{
+    call("glCreateProgram()");
+    GLuint program = next_name++;
+    link_status[program] = GL_FALSE;
+    return program;
+}
+
+void glDeleteProgram(GLuint program)
+{
+    call("glDeleteProgram(%u)", program);
+    link_status.erase(program);
+}
+
+void glLinkProgram(GLuint program)
+{
+    call("glLinkProgram(%u)", program);
+    link_status[program] = stub_gl_link_fails ? GL_FALSE : GL_TRUE;
+}
+
+void glGetProgramiv(GLuint program, GLenum name, GLint* params)
+{
+    call("glGetProgramiv(%u, 0x%x)", program, name);
+    if (name == GL_LINK_STATUS)
+    {
+        *params = link_status[program];
+    }
+    else if (name == GL_PROGRAM_BINARY_LENGTH)
+    {
+        *params = link_status[program] == GL_TRUE ? (GLint)sizeof(stub_binary) : 0;
+    }
+    else
+    {
+        *params = 0;
+    }
+}
+
+void glProgramParameteri(GLuint program, GLenum name, GLint value)
+{
+    call("glProgramParameteri(%u, 0x%x, %d)", program, name, value);
+}
+
+void glProgramBinary(GLuint program, GLenum format, const void* binary, GLsizei length)
+{
+    call("glProgramBinary(%u, 0x%x, %d)", program, format, length);
+    bool valid = format == stub_binary_format && length == (GLsizei)sizeof(stub_binary)
+        && memcmp(binary, stub_binary, sizeof(stub_binary)) == 0;
+    link_status[program] = valid && !stub_gl_rejects_binaries ? GL_TRUE : GL_FALSE;
+}
+
+void glGetProgramBinary(GLuint program, GLsizei size, GLsizei* length, GLenum* format, void* binary)
+{
+    call("glGetProgramBinary(%u, %d)", program, size);
+    GLsizei written = size < (GLsizei)sizeof(stub_binary) ? size : (GLsizei)sizeof(stub_binary);
+    memcpy(binary, stub_binary, written);
+    *format = stub_binary_format;
+    if (length != NULL)
+    {
+        *length = written;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+// Controls the stand-in GL functions of gl_stub.cpp. They don't draw anything: they count the calls,
+// optionally log them to compare with an expected sequence, and emulate just enough of a driver
+// (uniform locations, link status and program binaries) for the generated code to run.
+#include "glad/gl.h"
+#include <set>
+#include <string>
+
+// The number of GL calls since `stub_gl_reset`
+extern unsigned long long stub_gl_calls;
+
+// Whether the calls are logged, one per line, with the values the pointers point to
+extern bool stub_gl_logging;
+
+// Names glGetUniformLocation returns -1 for, as if the linker removed them
+extern std::set<std::string> stub_gl_inactive_uniforms;
+
+// Makes glLinkProgram fail
+extern bool stub_gl_link_fails;
+
+// Makes glProgramBinary reject every binary, as after a driver update
+extern bool stub_gl_rejects_binaries;
+
+// Clears the log, the call count, the locations and the programs, and restores the default behaviour.
+void stub_gl_reset();
+
+const std::string& stub_gl_log();
+
+// The programs created and not deleted yet
+int stub_gl_live_programs();
@@ -0,0 +1,97 @@
+#pragma once
+// A stand-in for the GL loader, so that the generated code can be compiled and run without a GL context.
+// It declares only what the generated code uses. The functions are defined in tests/stub/gl_stub.cpp,
+// which records the calls, see tests/stub/gl_stub.h.
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int GLuint;
+typedef int GLint;
+typedef unsigned int GLenum;
+typedef int GLsizei;
+typedef float GLfloat;
+typedef unsigned char GLboolean;
+typedef uint64_t GLuint64;
+typedef ptrdiff_t GLintptr;
+typedef ptrdiff_t GLsizeiptr;
+
+#define GL_FALSE 0
+#define GL_TRUE 1
+#define GL_TRIANGLES 0x0004
+
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_STATIC_DRAW 0x88E4
+#define GL_STREAM_DRAW 0x88E0
+#define GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT 0x8A34
+
+#define GL_CURRENT_PROGRAM 0x8B8D
+
+#define GL_TEXTURE0 0x84C0
+#define GL_TEXTURE_1D 0x0DE0
+#define GL_TEXTURE_2D 0x0DE1
+#define GL_TEXTURE_3D 0x806F
+#define GL_TEXTURE_CUBE_MAP 0x8513
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#define GL_TEXTURE_2D_MULTISAMPLE 0x9100
+#define GL_TEXTURE_BUFFER 0x8C2A
+#define GL_READ_WRITE 0x88BA
+#define GL_TEXTURE_INTERNAL_FORMAT 0x1003
+#define GL_RGBA8 0x8058
+#define GL_RGBA16F 0x881A
+#define GL_RGBA32F 0x8814
+#define GL_R32F 0x822E
+#define GL_R32UI 0x8236
+
+#define GL_LINK_STATUS 0x8B82
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+
+void glUseProgram(GLuint program);
+void glDrawArrays(GLenum mode, GLint first, GLsizei count);
+GLint glGetUniformLocation(GLuint program, const char* name);
+GLuint glGetUniformBlockIndex(GLuint program, const char* name);
+void glUniformBlockBinding(GLuint program, GLuint index, GLuint binding);
+
+void glUniform1f(GLint location, GLfloat value);
+void glUniform1i(GLint location, GLint value);
+void glUniform2fv(GLint location, GLsizei count, const GLfloat* value);
+void glUniform3fv(GLint location, GLsizei count, const GLfloat* value);
+void glUniform4fv(GLint location, GLsizei count, const GLfloat* value);
+void glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+void glUniformHandleui64ARB(GLint location, GLuint64 value);
+
+void glProgramUniform1f(GLuint program, GLint location, GLfloat value);
+void glProgramUniform1i(GLuint program, GLint location, GLint value);
+void glProgramUniform2fv(GLuint program, GLint location, GLsizei count, const GLfloat* value);
+void glProgramUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat* value);
+void glProgramUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat* value);
+void glProgramUniformMatrix3fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+void glProgramUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+void glProgramUniformHandleui64ARB(GLuint program, GLint location, GLuint64 value);
+
+void glGenBuffers(GLsizei n, GLuint* buffers);
+void glCreateBuffers(GLsizei n, GLuint* buffers);
+void glDeleteBuffers(GLsizei n, const GLuint* buffers);
+void glBindBuffer(GLenum target, GLuint buffer);
+void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+void glNamedBufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage);
+void glNamedBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+void glBindBufferBase(GLenum target, GLuint index, GLuint buffer);
+void glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+void glGetIntegerv(GLenum name, GLint* data);
+
+void glActiveTexture(GLenum texture);
+void glBindTexture(GLenum target, GLuint texture);
+void glBindTextureUnit(GLuint unit, GLuint texture);
+void glBindImageTexture(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+void glGetTextureLevelParameteriv(GLuint texture, GLint level, GLenum name, GLint* params);
+
+GLuint glCreateProgram();
+void glDeleteProgram(GLuint program);
+void glLinkProgram(GLuint program);
+void glGetProgramiv(GLuint program, GLenum name, GLint* params);
+void glProgramParameteri(GLuint program, GLenum name, GLint value);
+void glProgramBinary(GLuint program, GLenum format, const void* binary, GLsizei length);
+void glGetProgramBinary(GLuint program, GLsizei size, GLsizei* length, GLenum* format, void* binary);
@@ -0,0 +1,12 @@
+#pragma once
+// A stand-in for the parts of glm the generated code uses, see tests/stub/glad/gl.h.
+namespace glm
+{
+    typedef float float32;
+    struct vec2;
+    struct vec3;
+    struct vec4;
+    struct mat3;
+    struct mat4;
+    struct mat3x4;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "fwd.hpp"
+
+namespace glm
+{
+    struct vec2 { float x, y; };
+    struct vec3 { float x, y, z; };
+    struct vec4 { float x, y, z, w; };
+    struct mat3 { vec3 columns[3]; };
+    struct mat4 { vec4 columns[4]; };
+    // 3 columns of 4 rows, the layout of a mat3 in a uniform block
+    struct mat3x4
+    {
+        vec4 columns[3];
+        mat3x4() = default;
+        explicit mat3x4(const mat3& m)
+            : columns { { m.columns[0].x, m.columns[0].y, m.columns[0].z, 0 }, 
+                        { m.columns[1].x, m.columns[1].y, m.columns[1].z, 0 },
+                        { m.columns[2].x, m.columns[2].y, m.columns[2].z, 0 } }
+        {
+        }
+    };
+}
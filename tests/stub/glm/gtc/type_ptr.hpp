@@ -0,0 +1,8 @@
+#pragma once
+#include "../glm.hpp"
+
+namespace glm
+{
+    template<class T> float* value_ptr(T& value) { return (float*)&value; }
+    template<class T> const float* value_ptr(const T& value) { return (const float*)&value; }
+}